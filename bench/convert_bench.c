@@ -0,0 +1,138 @@
+/* convert_bench.c
+ * times the color conversion kernels against converting one pixel at a
+ * time the way png2gba used to, and checks they all agree */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "convert.h"
+
+/* the size of the synthetic image and how many times each run repeats */
+#define WIDTH 1024
+#define HEIGHT 1024
+#define RUNS 20
+
+/* the current time in seconds */
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the old way: a pixel iterator which steps through rows or tiles, with the
+ * color conversion done per pixel */
+void convert_per_pixel(unsigned short* dest, unsigned char** rows, int w,
+        int h, int channels, int tileize) {
+    int r = 0, c = 0, tr = 0, tc = 0;
+    while (r != h) {
+        unsigned char* ptr = &rows[r][c * channels];
+        unsigned short color = (ptr[2] >> 3) << 10;
+        color += (ptr[1] >> 3) << 5;
+        color += (ptr[0] >> 3);
+        *dest++ = color;
+
+        c++;
+        if (!tileize) {
+            if (c >= w) {
+                r++;
+                c = 0;
+            }
+        } else if (++tc >= 8) {
+            r++;
+            tr++;
+            c -= 8;
+            tc = 0;
+            if (tr >= 8) {
+                r -= 8;
+                tr = 0;
+                c += 8;
+            }
+            if (c >= w) {
+                tc = tr = c = 0;
+                r += 8;
+            }
+        }
+    }
+}
+
+/* the per pixel iterator, shaped like a kernel so it can be timed the same */
+void convert_rows_per_pixel(convert_kernel kernel, unsigned short* dest,
+        unsigned char** rows, int w, int h, int channels, int tileize,
+        unsigned short* band) {
+    (void) kernel;
+    (void) band;
+    convert_per_pixel(dest, rows, w, h, channels, tileize);
+}
+
+/* times one way of converting, returning seconds per run */
+double time_conversion(void (*convert)(convert_kernel, unsigned short*,
+            unsigned char**, int, int, int, int, unsigned short*), convert_kernel kernel,
+        unsigned short* dest, unsigned char** rows, int channels, int tileize) {
+    static unsigned short band[WIDTH * 8];
+    double start = now();
+    int run;
+    for (run = 0; run < RUNS; run++) {
+        convert(kernel, dest, rows, WIDTH, HEIGHT, channels, tileize, band);
+    }
+    return (now() - start) / RUNS;
+}
+
+int main() {
+    const char* names[] = {"scalar", "sse2", "avx2"};
+    convert_kernel kernels[] = {png2gba_convert_row_scalar,
+#ifdef CONVERT_SSE2
+        png2gba_convert_row_sse2, png2gba_convert_row_avx2
+#endif
+    };
+    int num_kernels = sizeof(kernels) / sizeof(kernels[0]);
+    if (num_kernels == 3 && !png2gba_convert_has_avx2()) {
+        num_kernels = 2;
+    }
+
+    unsigned short* expected = malloc(sizeof(unsigned short) * WIDTH * HEIGHT);
+    unsigned short* actual = malloc(sizeof(unsigned short) * WIDTH * HEIGHT);
+    unsigned char* rows[HEIGHT];
+    int channels, tileize, k, r, failed = 0;
+
+    printf("%-8s %-8s %-7s %10s %8s\n", "kernel", "channels", "order", "Mpixels/s", "speedup");
+    for (channels = 3; channels <= 4; channels++) {
+        /* a random image, each row its own allocation like read_png does */
+        srand(channels);
+        for (r = 0; r < HEIGHT; r++) {
+            rows[r] = malloc(WIDTH * channels);
+            int i;
+            for (i = 0; i < WIDTH * channels; i++) {
+                rows[r][i] = rand();
+            }
+        }
+
+        for (tileize = 0; tileize <= 1; tileize++) {
+            const char* order = tileize ? "tiles" : "rows";
+            double base = time_conversion(convert_rows_per_pixel, NULL,
+                    expected, rows, channels, tileize);
+            printf("%-8s %-8d %-7s %10.1f %7.2fx\n", "pixel", channels, order,
+                    WIDTH * HEIGHT / base / 1e6, 1.0);
+
+            for (k = 0; k < num_kernels; k++) {
+                memset(actual, 0, sizeof(unsigned short) * WIDTH * HEIGHT);
+                double seconds = time_conversion(png2gba_convert_rows_with, kernels[k],
+                        actual, rows, channels, tileize);
+                int same = !memcmp(expected, actual, sizeof(unsigned short) * WIDTH * HEIGHT);
+                printf("%-8s %-8d %-7s %10.1f %7.2fx%s\n", names[k], channels, order,
+                        WIDTH * HEIGHT / seconds / 1e6, base / seconds,
+                        same ? "" : "  MISMATCH");
+                failed |= !same;
+            }
+        }
+
+        for (r = 0; r < HEIGHT; r++) {
+            free(rows[r]);
+        }
+    }
+
+    free(expected);
+    free(actual);
+    return failed;
+}
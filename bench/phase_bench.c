@@ -0,0 +1,196 @@
+/* phase_bench.c
+ * converts a corpus of synthetic PNG images with the png2gba library and
+ * reports how long the decode, convert and emit phases of each took as JSON */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "png2gba.h"
+
+/* each case is converted until it has taken at least this long, and at
+ * least MIN_RUNS times */
+#define MIN_SECONDS 0.1
+#define MIN_RUNS 3
+
+/* the kinds of images in the corpus */
+const int sizes[] = {64, 256, 1024};
+const int channel_counts[] = {3, 4};
+const int color_counts[] = {16, 256, 4096};
+const int repeat_rates[] = {0, 50, 90};
+
+/* the modes each image is converted in: 16-bit colors, or a palette with
+ * quantizing and tiles, deduplicated when a screen map can hold them all */
+const char* mode_names[] = {"direct", "palette"};
+
+/* a PNG file being written to memory */
+struct PngFile {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+};
+
+/* the libpng write function for a PNG file in memory */
+void write_memory(png_structp png_writer, png_bytep data, png_size_t length) {
+    struct PngFile* file = png_get_io_ptr(png_writer);
+    if (file->size + length > file->capacity) {
+        file->capacity = (file->size + length) * 2;
+        file->data = realloc(file->data, file->capacity);
+    }
+    memcpy(file->data + file->size, data, length);
+    file->size += length;
+}
+void flush_memory(png_structp png_writer) {
+    (void) png_writer;
+}
+
+/* a small repeatable random number generator */
+unsigned int next_random(unsigned int* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/* builds an image of 8x8 tiles, each of which repeats an earlier tile
+ * repeat percent of the time, otherwise it is random pixels from a set of
+ * distinct 15-bit colors, then encodes it as a PNG */
+void make_png(struct PngFile* file, int size, int channels, int colors, int repeat) {
+    unsigned int state = 0x9e3779b9u ^ (size * 31 + channels * 7 + colors + repeat);
+    int tiles_across = size / PNG2GBA_TILE_SIZE;
+    int num_tiles = tiles_across * tiles_across;
+    int rowbytes = size * channels;
+    unsigned char* pixels = malloc(rowbytes * size);
+    unsigned char* set = malloc(colors * 3);
+    int i, t, r, c;
+
+    /* spread the colors over the 15-bit color space */
+    for (i = 0; i < colors; i++) {
+        int color = (int) ((long) i * 32768 / colors);
+        set[i * 3] = (color & 0x1f) << 3;
+        set[i * 3 + 1] = ((color >> 5) & 0x1f) << 3;
+        set[i * 3 + 2] = ((color >> 10) & 0x1f) << 3;
+    }
+
+    for (t = 0; t < num_tiles; t++) {
+        int tr = (t / tiles_across) * PNG2GBA_TILE_SIZE;
+        int tc = (t % tiles_across) * PNG2GBA_TILE_SIZE;
+        int source = -1;
+        if (t > 0 && (int) (next_random(&state) % 100) < repeat) {
+            source = next_random(&state) % t;
+        }
+        for (r = 0; r < PNG2GBA_TILE_SIZE; r++) {
+            unsigned char* dest = pixels + (tr + r) * rowbytes + tc * channels;
+            if (source >= 0) {
+                int sr = (source / tiles_across) * PNG2GBA_TILE_SIZE;
+                int sc = (source % tiles_across) * PNG2GBA_TILE_SIZE;
+                memcpy(dest, pixels + (sr + r) * rowbytes + sc * channels,
+                        PNG2GBA_TILE_SIZE * channels);
+                continue;
+            }
+            for (c = 0; c < PNG2GBA_TILE_SIZE; c++) {
+                memcpy(dest + c * channels, set + (next_random(&state) % colors) * 3, 3);
+                if (channels == 4) {
+                    dest[c * channels + 3] = 0xff;
+                }
+            }
+        }
+    }
+
+    png_structp png_writer = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop png_info = png_create_info_struct(png_writer);
+    png_bytep* rows = malloc(sizeof(png_bytep) * size);
+    for (r = 0; r < size; r++) {
+        rows[r] = pixels + r * rowbytes;
+    }
+    file->size = 0;
+    png_set_write_fn(png_writer, file, write_memory, flush_memory);
+    png_set_IHDR(png_writer, png_info, size, size, 8,
+            channels == 4 ? PNG_COLOR_TYPE_RGBA : PNG_COLOR_TYPE_RGB,
+            PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png_writer, png_info);
+    png_write_image(png_writer, rows);
+    png_write_end(png_writer, NULL);
+    png_destroy_write_struct(&png_writer, &png_info);
+
+    free(rows);
+    free(set);
+    free(pixels);
+}
+
+/* converts one PNG over and over, printing its timings as a JSON object */
+void run_case(struct PngFile* file, int size, int channels, int colors,
+        int repeat, int mode, int first) {
+    struct png2gba_options options;
+    struct png2gba_context context;
+    struct png2gba_timings total = {0, 0, 0, 0, 0};
+    size_t output_size = 0;
+    int runs = 0;
+
+    png2gba_default_options(&options);
+    if (mode == 1) {
+        options.palette = 1;
+        options.quantize = 1;
+        options.tileize = 1;
+        options.dedup = (size / PNG2GBA_TILE_SIZE) * (size / PNG2GBA_TILE_SIZE)
+            <= PNG2GBA_MAX_SCREEN_TILES;
+    }
+    png2gba_init_context(&context, &options);
+
+    while (runs < MIN_RUNS || total.decode + total.convert + total.palette + total.emit < MIN_SECONDS) {
+        struct png2gba_output output;
+        memset(&output, 0, sizeof(struct png2gba_output));
+        struct png2gba_image* image = png2gba_read_memory(&context, file->data, file->size);
+        if (!image || png2gba_convert(&context, image, &output, "bench", 0, 1, NULL)) {
+            fprintf(stderr, "Error: %s\n", png2gba_error_message(context.error));
+            exit(-1);
+        }
+        png2gba_free_image(image);
+        total.decode += context.timings.decode;
+        total.convert += context.timings.convert;
+        total.palette += context.timings.palette;
+        total.emit += context.timings.emit;
+        output_size = output.data.size + output.palette.size;
+        png2gba_free_output(&output);
+        runs++;
+    }
+
+    double seconds = (total.decode + total.convert + total.palette + total.emit) / runs;
+    printf("%s\n    {\"width\": %d, \"height\": %d, \"channels\": %d, \"colors\": %d, "
+            "\"repeat\": %d, \"mode\": \"%s\", \"png_bytes\": %zu, \"output_bytes\": %zu, "
+            "\"runs\": %d, \"decode_ms\": %.4f, \"convert_ms\": %.4f, \"palette_ms\": %.4f, "
+            "\"emit_ms\": %.4f, \"total_ms\": %.4f, \"mpixels_per_s\": %.2f}",
+            first ? "" : ",", size, size, channels, colors, repeat, mode_names[mode],
+            file->size, output_size, runs, total.decode * 1000 / runs,
+            total.convert * 1000 / runs, total.palette * 1000 / runs,
+            total.emit * 1000 / runs, seconds * 1000, (double) size * size / seconds / 1e6);
+}
+
+int main() {
+    struct PngFile file = {NULL, 0, 0};
+    unsigned int s, ch, co, re;
+    int mode;
+    int first = 1;
+
+    printf("{\n  \"benchmark\": \"png2gba phases\",\n  \"cases\": [");
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (ch = 0; ch < sizeof(channel_counts) / sizeof(channel_counts[0]); ch++) {
+            for (co = 0; co < sizeof(color_counts) / sizeof(color_counts[0]); co++) {
+                for (re = 0; re < sizeof(repeat_rates) / sizeof(repeat_rates[0]); re++) {
+                    make_png(&file, sizes[s], channel_counts[ch], color_counts[co],
+                            repeat_rates[re]);
+                    for (mode = 0; mode < 2; mode++) {
+                        run_case(&file, sizes[s], channel_counts[ch], color_counts[co],
+                                repeat_rates[re], mode, first);
+                        first = 0;
+                        fflush(stdout);
+                    }
+                }
+            }
+        }
+    }
+    printf("\n  ]\n}\n");
+
+    free(file.data);
+    return 0;
+}
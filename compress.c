@@ -0,0 +1,350 @@
+/* compress.c
+ * compresses data into the formats the GBA BIOS decompression calls read,
+ * LZ77 (type 0x10), Huffman (type 0x20) and run length (type 0x30) */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compress.h"
+
+/* the LZ77 window and match lengths the BIOS supports, matches are kept at
+ * least 2 bytes back so the data can be decompressed straight to VRAM */
+#define LZ_WINDOW 4096
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH 18
+#define LZ_MIN_DISTANCE 2
+
+/* the hash chains which find earlier matches, and how many earlier
+ * positions are tried at most for each match */
+#define LZ_HASH_BITS 14
+#define LZ_MAX_CHAIN 256
+
+/* the longest runs and literal stretches of the run length format */
+#define RLE_MAX_RUN 130
+#define RLE_MAX_LITERAL 128
+
+/* the most symbols of Huffman coded data, with 8-bit symbols */
+#define HUFFMAN_SYMBOLS 256
+
+/* the furthest a Huffman tree node can be from its children, in pairs */
+#define HUFFMAN_MAX_OFFSET 63
+
+/* appends the header every format starts with, the type and the size of
+ * the data once it is decompressed */
+static void put_header(struct png2gba_buffer* out, int type, size_t size) {
+    unsigned char header[4] = {type, size & 0xff, (size >> 8) & 0xff, (size >> 16) & 0xff};
+    png2gba_buffer_write(out, header, 4);
+}
+
+/* pads a buffer with zeroes up to a multiple of 4 bytes */
+static void pad4(struct png2gba_buffer* out) {
+    while (out->size & 3) {
+        png2gba_buffer_write(out, "", 1);
+    }
+}
+
+/* hashes the 3 bytes a match has to start with */
+static inline unsigned int lz_hash(const unsigned char* p) {
+    return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+int png2gba_compress_lz77(struct png2gba_buffer* out, const unsigned char* data, size_t size) {
+    if (size > MAX_COMPRESS_SIZE) {
+        return PNG2GBA_ERROR_COMPRESS_SIZE;
+    }
+    int* head = malloc(sizeof(int) << LZ_HASH_BITS);
+    int* prev = malloc(sizeof(int) * LZ_WINDOW);
+    size_t pos = 0, inserted = 0;
+    memset(head, 0xff, sizeof(int) << LZ_HASH_BITS);
+
+    put_header(out, 0x10, size);
+    while (pos < size) {
+        /* every 8 blocks are led by a byte of flags, set for a match */
+        size_t flags_at = out->size;
+        unsigned char flags = 0;
+        int block;
+        png2gba_buffer_write(out, "", 1);
+
+        for (block = 0; block < 8 && pos < size; block++) {
+            int best_length = 0, best_distance = 0;
+            int max_length = size - pos < LZ_MAX_MATCH ? size - pos : LZ_MAX_MATCH;
+
+            /* walk back through the earlier positions with the same hash */
+            if (max_length >= LZ_MIN_MATCH) {
+                int candidate = head[lz_hash(data + pos)];
+                int chain = LZ_MAX_CHAIN;
+                while (candidate >= 0 && (int) pos - candidate <= LZ_WINDOW && chain-- > 0) {
+                    int distance = pos - candidate;
+                    if (distance >= LZ_MIN_DISTANCE
+                            && data[candidate + best_length] == data[pos + best_length]) {
+                        int length = 0;
+                        while (length < max_length && data[candidate + length] == data[pos + length]) {
+                            length++;
+                        }
+                        if (length > best_length) {
+                            best_length = length;
+                            best_distance = distance;
+                            if (length == max_length) {
+                                break;
+                            }
+                        }
+                    }
+                    candidate = prev[candidate % LZ_WINDOW];
+                }
+            }
+
+            if (best_length >= LZ_MIN_MATCH) {
+                unsigned char match[2] = {((best_length - LZ_MIN_MATCH) << 4) | ((best_distance - 1) >> 8),
+                    (best_distance - 1) & 0xff};
+                png2gba_buffer_write(out, match, 2);
+                flags |= 0x80 >> block;
+            } else {
+                best_length = 1;
+                png2gba_buffer_write(out, data + pos, 1);
+            }
+            pos += best_length;
+
+            /* every position passed over goes into the chains */
+            for (; inserted < pos && inserted + LZ_MIN_MATCH <= size; inserted++) {
+                unsigned int hash = lz_hash(data + inserted);
+                prev[inserted % LZ_WINDOW] = head[hash];
+                head[hash] = inserted;
+            }
+        }
+        out->data[flags_at] = flags;
+    }
+    pad4(out);
+
+    free(head);
+    free(prev);
+    return PNG2GBA_OK;
+}
+
+int png2gba_compress_rle(struct png2gba_buffer* out, const unsigned char* data, size_t size) {
+    size_t pos = 0;
+    if (size > MAX_COMPRESS_SIZE) {
+        return PNG2GBA_ERROR_COMPRESS_SIZE;
+    }
+    put_header(out, 0x30, size);
+    while (pos < size) {
+        /* a run of at least 3 bytes is worth a block of its own */
+        size_t run = 1;
+        while (pos + run < size && run < RLE_MAX_RUN && data[pos + run] == data[pos]) {
+            run++;
+        }
+        if (run >= 3) {
+            unsigned char block[2] = {0x80 | (run - 3), data[pos]};
+            png2gba_buffer_write(out, block, 2);
+            pos += run;
+            continue;
+        }
+
+        /* otherwise copy bytes up to the next run */
+        size_t length = 0;
+        while (pos + length < size && length < RLE_MAX_LITERAL) {
+            if (pos + length + 2 < size && data[pos + length] == data[pos + length + 1]
+                    && data[pos + length] == data[pos + length + 2]) {
+                break;
+            }
+            length++;
+        }
+        unsigned char count = length - 1;
+        png2gba_buffer_write(out, &count, 1);
+        png2gba_buffer_write(out, data + pos, length);
+        pos += length;
+    }
+    pad4(out);
+    return PNG2GBA_OK;
+}
+
+/* a node of a Huffman tree, leaves have no children */
+struct HuffmanNode {
+    size_t count;
+    int symbol;
+    int children[2];
+    int pair;
+    int slot;
+};
+
+/* gives every symbol under a node its code, the bits from the root down */
+static void assign_codes(struct HuffmanNode* nodes, int node, uint64_t code,
+        int length, uint64_t* codes, int* lengths) {
+    if (nodes[node].children[0] < 0) {
+        codes[nodes[node].symbol] = code;
+        lengths[nodes[node].symbol] = length;
+        return;
+    }
+    assign_codes(nodes, nodes[node].children[0], code << 1, length + 1, codes, lengths);
+    assign_codes(nodes, nodes[node].children[1], (code << 1) | 1, length + 1, codes, lengths);
+}
+
+/* Huffman codes data as symbols of 4 or 8 bits, returns 0 without writing
+ * anything if the tree can't be laid out within the node offset limit */
+static int huffman(struct png2gba_buffer* out, const unsigned char* data, size_t size, int bits) {
+    int num_symbols = 1 << bits;
+    size_t num_codes = size * 8 / bits;
+    struct HuffmanNode nodes[HUFFMAN_SYMBOLS * 2];
+    int active[HUFFMAN_SYMBOLS];
+    int num_nodes = 0, num_active = 0;
+    size_t i;
+    int s;
+
+    /* the symbols of 4-bit data are the low then high nibble of each byte */
+    for (s = 0; s < num_symbols; s++) {
+        nodes[s].count = 0;
+        nodes[s].symbol = s;
+        nodes[s].children[0] = nodes[s].children[1] = -1;
+    }
+    for (i = 0; i < num_codes; i++) {
+        int symbol = bits == 8 ? data[i] : (data[i / 2] >> ((i & 1) * 4)) & 0xf;
+        nodes[symbol].count++;
+    }
+    num_nodes = num_symbols;
+
+    for (s = 0; s < num_symbols; s++) {
+        if (nodes[s].count) {
+            active[num_active++] = s;
+        }
+    }
+
+    /* the tree needs two leaves at least, so unused symbols fill in */
+    for (s = 0; num_active < 2; s++) {
+        if (!nodes[s].count) {
+            active[num_active++] = s;
+        }
+    }
+
+    /* join the two least used nodes until just the root is left */
+    while (num_active > 1) {
+        int a, lo[2] = {0, 1};
+        if (nodes[active[1]].count < nodes[active[0]].count) {
+            lo[0] = 1;
+            lo[1] = 0;
+        }
+        for (a = 2; a < num_active; a++) {
+            if (nodes[active[a]].count < nodes[active[lo[0]]].count) {
+                lo[1] = lo[0];
+                lo[0] = a;
+            } else if (nodes[active[a]].count < nodes[active[lo[1]]].count) {
+                lo[1] = a;
+            }
+        }
+        struct HuffmanNode* parent = &nodes[num_nodes];
+        parent->children[0] = active[lo[0]];
+        parent->children[1] = active[lo[1]];
+        parent->count = nodes[active[lo[0]]].count + nodes[active[lo[1]]].count;
+        parent->symbol = -1;
+        active[lo[0]] = num_nodes++;
+        active[lo[1]] = active[--num_active];
+    }
+    int root = active[0];
+
+    /* the table is the root node followed by pairs of child nodes, each
+     * pair is laid out breadth first so every node is as close as it can be
+     * to its children, pair is the one a node is in and slot is where it
+     * goes in the table, after the size byte */
+    int order[HUFFMAN_SYMBOLS * 2];
+    int num_pairs = 0, head = 0, c;
+    nodes[root].pair = -1;
+    nodes[root].slot = 1;
+    order[num_pairs++] = root;
+    while (head < num_pairs) {
+        int node = order[head++];
+        for (c = 0; c < 2; c++) {
+            int child = nodes[node].children[c];
+            nodes[child].pair = head - 1;
+            nodes[child].slot = 2 + (head - 1) * 2 + c;
+            if (nodes[child].children[0] >= 0) {
+                order[num_pairs++] = child;
+            }
+        }
+    }
+
+    /* the children of the node order[p] are pair p, an offset of 0 is the
+     * pair right after the one the node is in */
+    unsigned char table[HUFFMAN_SYMBOLS * 2 + 4];
+    int p;
+    for (p = 0; p < num_pairs; p++) {
+        int node = order[p];
+        int offset = p - nodes[node].pair - 1;
+        if (offset > HUFFMAN_MAX_OFFSET) {
+            return 0;
+        }
+        unsigned char value = offset;
+        for (c = 0; c < 2; c++) {
+            int child = nodes[node].children[c];
+            if (nodes[child].children[0] < 0) {
+                value |= 0x80 >> c;
+                table[2 + p * 2 + c] = nodes[child].symbol;
+            }
+        }
+        table[nodes[node].slot] = value;
+    }
+
+    /* the tree table, starting with its size, ends on a 4 byte boundary */
+    int table_size = 2 + num_pairs * 2;
+    while ((table_size + 4) & 3) {
+        table[table_size++] = 0;
+    }
+    table[0] = table_size / 2 - 1;
+
+    uint64_t codes[HUFFMAN_SYMBOLS];
+    int lengths[HUFFMAN_SYMBOLS];
+    assign_codes(nodes, root, 0, 0, codes, lengths);
+
+    put_header(out, 0x20 | bits, size);
+    png2gba_buffer_write(out, table, table_size);
+
+    /* the codes are packed into 32-bit words from the top bit down */
+    uint32_t word = 0;
+    int used = 0;
+    for (i = 0; i < num_codes; i++) {
+        int symbol = bits == 8 ? data[i] : (data[i / 2] >> ((i & 1) * 4)) & 0xf;
+        int b;
+        for (b = lengths[symbol] - 1; b >= 0; b--) {
+            word |= (uint32_t) ((codes[symbol] >> b) & 1) << (31 - used);
+            if (++used == 32) {
+                unsigned char bytes[4] = {word & 0xff, (word >> 8) & 0xff,
+                    (word >> 16) & 0xff, word >> 24};
+                png2gba_buffer_write(out, bytes, 4);
+                word = 0;
+                used = 0;
+            }
+        }
+    }
+    if (used) {
+        unsigned char bytes[4] = {word & 0xff, (word >> 8) & 0xff,
+            (word >> 16) & 0xff, word >> 24};
+        png2gba_buffer_write(out, bytes, 4);
+    }
+    return 1;
+}
+
+int png2gba_compress_huffman(struct png2gba_buffer* out, const unsigned char* data, size_t size) {
+    if (size > MAX_COMPRESS_SIZE) {
+        return PNG2GBA_ERROR_COMPRESS_SIZE;
+    }
+
+    /* 8-bit symbols compress better, but with many distinct bytes the tree
+     * may not fit the node format, which 16 nibbles always do */
+    if (!huffman(out, data, size, 8)) {
+        huffman(out, data, size, 4);
+    }
+    return PNG2GBA_OK;
+}
+
+int png2gba_compress_data(struct png2gba_buffer* out, const unsigned char* data, size_t size,
+        enum png2gba_compression compression) {
+    switch (compression) {
+        case PNG2GBA_COMPRESS_LZ77:
+            return png2gba_compress_lz77(out, data, size);
+        case PNG2GBA_COMPRESS_RLE:
+            return png2gba_compress_rle(out, data, size);
+        case PNG2GBA_COMPRESS_HUFFMAN:
+            return png2gba_compress_huffman(out, data, size);
+        default:
+            png2gba_buffer_write(out, data, size);
+            return PNG2GBA_OK;
+    }
+}
@@ -0,0 +1,24 @@
+/* compress.h
+ * compresses data into the formats the GBA BIOS decompression calls read,
+ * LZ77 (type 0x10), Huffman (type 0x20) and run length (type 0x30) */
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include "png2gba_private.h"
+
+/* the most bytes the 24-bit size in the header can hold */
+#define MAX_COMPRESS_SIZE 0xffffff
+
+/* each of these appends the 4 byte header and the compressed data to out,
+ * padded to a multiple of 4 bytes as the BIOS requires, returns an error
+ * code, with nothing written when there is too much data for the header */
+int png2gba_compress_lz77(struct png2gba_buffer* out, const unsigned char* data, size_t size);
+int png2gba_compress_rle(struct png2gba_buffer* out, const unsigned char* data, size_t size);
+int png2gba_compress_huffman(struct png2gba_buffer* out, const unsigned char* data, size_t size);
+
+/* compresses data with the given kind of compression, returns an error code */
+int png2gba_compress_data(struct png2gba_buffer* out, const unsigned char* data, size_t size,
+        enum png2gba_compression compression);
+
+#endif
@@ -0,0 +1,205 @@
+/* convert.c
+ * converts rows of RGB or RGBA pixels into 15-bit GBA colors, using SSE2 or
+ * AVX2 where the CPU has them, and rows of palette indices through a lookup
+ * table */
+
+#include <string.h>
+
+#include "convert.h"
+
+#ifdef CONVERT_SSE2
+#include <immintrin.h>
+#endif
+
+/* the GBA always uses 8x8 tiles */
+#define PNG2GBA_TILE_SIZE 8
+
+/* the kernel picked by png2gba_init_convert */
+static convert_kernel best_kernel = png2gba_convert_row_scalar;
+
+/* converts one pixel, dropping the low 3 bits of each component */
+static inline unsigned short convert_pixel(const unsigned char* ptr) {
+    unsigned short color = (ptr[2] >> 3) << 10;
+    color += (ptr[1] >> 3) << 5;
+    color += (ptr[0] >> 3);
+    return color;
+}
+
+void png2gba_convert_row_scalar(unsigned short* dest, const unsigned char* src,
+        int count, int channels) {
+    int i;
+    for (i = 0; i < count; i++, src += channels) {
+        dest[i] = convert_pixel(src);
+    }
+}
+
+#ifdef CONVERT_SSE2
+
+/* packs pixels held as 32-bit little endian RGBx words into 15-bit colors
+ * in the low half of each word */
+#define PACK_WORDS(v, AND, SRLI, OR) \
+    OR(OR(AND(SRLI(v, 3), mask_r), AND(SRLI(v, 6), mask_g)), AND(SRLI(v, 9), mask_b))
+
+__attribute__((target("sse2")))
+void png2gba_convert_row_sse2(unsigned short* dest, const unsigned char* src,
+        int count, int channels) {
+    const __m128i mask_r = _mm_set1_epi32(0x001f);
+    const __m128i mask_g = _mm_set1_epi32(0x03e0);
+    const __m128i mask_b = _mm_set1_epi32(0x7c00);
+    int i = 0;
+
+    if (channels == 4) {
+        /* 8 pixels are two straight loads */
+        for (; i + 8 <= count; i += 8, src += 32) {
+            __m128i a = _mm_loadu_si128((const __m128i*) src);
+            __m128i b = _mm_loadu_si128((const __m128i*) (src + 16));
+            a = PACK_WORDS(a, _mm_and_si128, _mm_srli_epi32, _mm_or_si128);
+            b = PACK_WORDS(b, _mm_and_si128, _mm_srli_epi32, _mm_or_si128);
+            _mm_storeu_si128((__m128i*) (dest + i), _mm_packs_epi32(a, b));
+        }
+    } else {
+        /* without a byte shuffle, 4 pixels are lined up into words by
+         * shifting a load along 3 bytes at a time, each load reads 16 bytes
+         * for 12 so stop while it stays in the row */
+        for (; i + 10 <= count; i += 8, src += 24) {
+            __m128i lo = _mm_loadu_si128((const __m128i*) src);
+            __m128i hi = _mm_loadu_si128((const __m128i*) (src + 12));
+            __m128i a = _mm_unpacklo_epi64(
+                    _mm_unpacklo_epi32(lo, _mm_srli_si128(lo, 3)),
+                    _mm_unpacklo_epi32(_mm_srli_si128(lo, 6), _mm_srli_si128(lo, 9)));
+            __m128i b = _mm_unpacklo_epi64(
+                    _mm_unpacklo_epi32(hi, _mm_srli_si128(hi, 3)),
+                    _mm_unpacklo_epi32(_mm_srli_si128(hi, 6), _mm_srli_si128(hi, 9)));
+            a = PACK_WORDS(a, _mm_and_si128, _mm_srli_epi32, _mm_or_si128);
+            b = PACK_WORDS(b, _mm_and_si128, _mm_srli_epi32, _mm_or_si128);
+            _mm_storeu_si128((__m128i*) (dest + i), _mm_packs_epi32(a, b));
+        }
+    }
+
+    /* and whatever is left over */
+    png2gba_convert_row_scalar(dest + i, src, count - i, channels);
+}
+
+__attribute__((target("avx2")))
+void png2gba_convert_row_avx2(unsigned short* dest, const unsigned char* src,
+        int count, int channels) {
+    const __m256i mask_r = _mm256_set1_epi32(0x001f);
+    const __m256i mask_g = _mm256_set1_epi32(0x03e0);
+    const __m256i mask_b = _mm256_set1_epi32(0x7c00);
+
+    /* spreads 4 RGB pixels in each lane out into 4 RGBx words */
+    const __m256i spread = _mm256_setr_epi8(
+            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    int i = 0;
+
+    /* 16 pixels at a time, the pack works per lane so the halves are put
+     * back in order afterwards */
+    if (channels == 4) {
+        for (; i + 16 <= count; i += 16, src += 64) {
+            __m256i a = _mm256_loadu_si256((const __m256i*) src);
+            __m256i b = _mm256_loadu_si256((const __m256i*) (src + 32));
+            a = PACK_WORDS(a, _mm256_and_si256, _mm256_srli_epi32, _mm256_or_si256);
+            b = PACK_WORDS(b, _mm256_and_si256, _mm256_srli_epi32, _mm256_or_si256);
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+            _mm256_storeu_si256((__m256i*) (dest + i), packed);
+        }
+    } else {
+        /* each lane loads 16 bytes for 12, so leave room past the end */
+        for (; i + 18 <= count; i += 16, src += 48) {
+            __m256i a = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                        _mm_loadu_si128((const __m128i*) src)),
+                    _mm_loadu_si128((const __m128i*) (src + 12)), 1);
+            __m256i b = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                        _mm_loadu_si128((const __m128i*) (src + 24))),
+                    _mm_loadu_si128((const __m128i*) (src + 36)), 1);
+            a = _mm256_shuffle_epi8(a, spread);
+            b = _mm256_shuffle_epi8(b, spread);
+            a = PACK_WORDS(a, _mm256_and_si256, _mm256_srli_epi32, _mm256_or_si256);
+            b = PACK_WORDS(b, _mm256_and_si256, _mm256_srli_epi32, _mm256_or_si256);
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+            _mm256_storeu_si256((__m256i*) (dest + i), packed);
+        }
+    }
+
+    /* and whatever is left over */
+    png2gba_convert_row_sse2(dest + i, src, count - i, channels);
+}
+
+#endif
+
+void png2gba_init_convert() {
+#ifdef CONVERT_SSE2
+    best_kernel = png2gba_convert_has_avx2() ? png2gba_convert_row_avx2 : png2gba_convert_row_sse2;
+#endif
+}
+
+int png2gba_convert_has_avx2() {
+#ifdef CONVERT_AVX2
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return 0;
+#endif
+}
+
+void png2gba_convert_row(unsigned short* dest, const unsigned char* src, int count,
+        int channels) {
+    best_kernel(dest, src, count, channels);
+}
+
+void png2gba_convert_rows(unsigned short* dest, unsigned char** rows, int w, int h,
+        int channels, int tileize, unsigned short* band) {
+    png2gba_convert_rows_with(best_kernel, dest, rows, w, h, channels, tileize, band);
+}
+
+void png2gba_convert_rows_with(convert_kernel kernel, unsigned short* dest,
+        unsigned char** rows, int w, int h, int channels, int tileize,
+        unsigned short* band) {
+    int r, c, tr;
+
+    /* in order, every row goes straight into place */
+    if (!tileize) {
+        for (r = 0; r < h; r++) {
+            kernel(dest + r * w, rows[r], w, channels);
+        }
+        return;
+    }
+
+    /* otherwise each band of 8 rows is converted whole and then its tiles
+     * are gathered out a row of 8 colors at a time */
+    for (r = 0; r < h; r += PNG2GBA_TILE_SIZE) {
+        for (tr = 0; tr < PNG2GBA_TILE_SIZE; tr++) {
+            kernel(band + tr * w, rows[r + tr], w, channels);
+        }
+        for (c = 0; c < w; c += PNG2GBA_TILE_SIZE) {
+            for (tr = 0; tr < PNG2GBA_TILE_SIZE; tr++) {
+                memcpy(dest, band + tr * w + c, sizeof(unsigned short) * PNG2GBA_TILE_SIZE);
+                dest += PNG2GBA_TILE_SIZE;
+            }
+        }
+    }
+}
+
+void png2gba_convert_indexed_rows(unsigned short* dest, unsigned char** rows, int w,
+        int h, const unsigned short* lookup, int tileize) {
+    int r, c, i;
+    for (r = 0; r < h; r++) {
+        const unsigned char* src = rows[r];
+        if (!tileize) {
+            for (c = 0; c < w; c++) {
+                dest[r * w + c] = lookup[src[c]];
+            }
+            continue;
+        }
+
+        /* each 8 pixels of the row go into the same row of the next tile */
+        unsigned short* tile_row = dest + (r / PNG2GBA_TILE_SIZE) * w * PNG2GBA_TILE_SIZE
+            + (r % PNG2GBA_TILE_SIZE) * PNG2GBA_TILE_SIZE;
+        for (c = 0; c < w; c += PNG2GBA_TILE_SIZE) {
+            for (i = 0; i < PNG2GBA_TILE_SIZE; i++) {
+                tile_row[c * PNG2GBA_TILE_SIZE + i] = lookup[src[c + i]];
+            }
+        }
+    }
+}
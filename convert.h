@@ -0,0 +1,55 @@
+/* convert.h
+ * converts rows of RGB or RGBA pixels into 15-bit GBA colors, using SSE2 or
+ * AVX2 where the CPU has them, and rows of palette indices through a lookup
+ * table */
+
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CONVERT_SSE2 1
+#define CONVERT_AVX2 1
+#endif
+
+/* converts count pixels of 3 or 4 channels into 15-bit colors */
+typedef void (*convert_kernel)(unsigned short* dest, const unsigned char* src,
+        int count, int channels);
+
+/* the kernels themselves, the SIMD ones only exist on x86 */
+void png2gba_convert_row_scalar(unsigned short* dest, const unsigned char* src,
+        int count, int channels);
+#ifdef CONVERT_SSE2
+void png2gba_convert_row_sse2(unsigned short* dest, const unsigned char* src,
+        int count, int channels);
+void png2gba_convert_row_avx2(unsigned short* dest, const unsigned char* src,
+        int count, int channels);
+#endif
+
+/* picks the fastest kernel this CPU can run, must be called before
+ * png2gba_convert_row or png2gba_convert_rows */
+void png2gba_init_convert();
+
+/* whether the CPU can run the AVX2 kernel */
+int png2gba_convert_has_avx2();
+
+/* converts one row of pixels with the fastest kernel */
+void png2gba_convert_row(unsigned short* dest, const unsigned char* src, int count,
+        int channels);
+
+/* converts a whole image given as rows into dest, in tile order or not,
+ * tile order needs a width and height which are multiples of 8, and band,
+ * room for 8 rows of colors which the tiles are gathered from */
+void png2gba_convert_rows(unsigned short* dest, unsigned char** rows, int w, int h,
+        int channels, int tileize, unsigned short* band);
+
+/* the same, with a given kernel */
+void png2gba_convert_rows_with(convert_kernel kernel, unsigned short* dest,
+        unsigned char** rows, int w, int h, int channels, int tileize,
+        unsigned short* band);
+
+/* converts a whole image given as rows of one byte palette indices into
+ * dest, each index becoming its entry of lookup, in tile order or not */
+void png2gba_convert_indexed_rows(unsigned short* dest, unsigned char** rows, int w,
+        int h, const unsigned short* lookup, int tileize);
+
+#endif
@@ -0,0 +1,2502 @@
+/* libpng2gba.c
+ * the png2gba library, which does the actual conversion from PNG images
+ * into GBA data for the png2gba program or any other program using it */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define PNG_DEBUG 3
+#include <png.h>
+
+#include "png2gba_private.h"
+#include "convert.h"
+#include "compress.h"
+
+/* the max 8-bit or 16-bit values on a row
+ * this only affects aesthetics by keeping the files from exceeding a width
+ * of 80 characters */
+#define MAX_ROW8 12
+#define MAX_ROW16 9
+#define MAX_ROW32 6
+
+/* the file extension used for each format when no output name is given */
+const char* png2gba_format_extensions[] = {".h", ".bin", ".o"};
+
+/* the linker section used for each placement */
+const char* png2gba_section_names[] = {".rodata", ".ewram", ".iwram"};
+
+/* the message for each error code */
+static const char* error_messages[] = {
+    "No error!",
+    "This does not seem to be a valid PNG file!",
+    "Could not read PNG file!",
+    "PNG file is not in a supported format!",
+    "Too many colors in image for a palette!",
+    "Image size must be a multiple of 8 to tileize!",
+    "A tile has too many colors for a 16 color palette bank!",
+    "Too many palette banks needed for the tiles of the image!",
+    "Every frame of an animation must be the same size!",
+    "Too many unique tiles for a screen map!",
+    "Too much data to compress, the BIOS can only decompress up to 16MB!"
+};
+
+const char* png2gba_error_message(int error) {
+    if (error < 0 || error >= (int) (sizeof(error_messages) / sizeof(error_messages[0]))) {
+        return "Unknown error!";
+    }
+    return error_messages[error];
+}
+
+/* the current time in seconds, for timing the phases of a conversion */
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* keeps an error in the context and passes it back */
+static int fail(struct png2gba_context* context, int error) {
+    context->error = error;
+    return error;
+}
+
+/* arenas hand out memory from blocks of at least this size, anything over a
+ * quarter of it gets a block of its own so the current one can keep going */
+#define ARENA_BLOCK_SIZE 65536
+
+/* everything an arena hands out is aligned for any use, including SIMD */
+#define ARENA_ALIGN 32
+
+/* a block of an arena, whose memory follows it */
+struct png2gba_arena_block {
+    struct png2gba_arena_block* next;
+    size_t size;
+    size_t used;
+};
+
+/* the room the block header takes, keeping what follows aligned */
+#define ARENA_HEADER ((sizeof(struct png2gba_arena_block) + ARENA_ALIGN - 1) \
+        & ~(size_t) (ARENA_ALIGN - 1))
+
+/* hands out size bytes from an arena, which stay until it is freed */
+static void* arena_alloc(struct png2gba_arena* arena, size_t size) {
+    struct png2gba_arena_block* block = arena->blocks;
+    size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+    if (block && block->used + size <= block->size) {
+        block->used += size;
+        return (char*) block + ARENA_HEADER + block->used - size;
+    }
+
+    /* start a new block, big ones go behind the current block */
+    size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    struct png2gba_arena_block* added = malloc(ARENA_HEADER + block_size);
+    if (!added) {
+        fprintf(stderr, "Error: Out of memory!\n");
+        abort();
+    }
+    added->size = block_size;
+    added->used = size;
+    if (block && size > ARENA_BLOCK_SIZE / 4) {
+        added->next = block->next;
+        block->next = added;
+    } else {
+        added->next = block;
+        arena->blocks = added;
+    }
+    return (char*) added + ARENA_HEADER;
+}
+
+/* formats a string into memory from an arena */
+static char* arena_printf(struct png2gba_arena* arena, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    char* text = arena_alloc(arena, length + 1);
+    va_start(args, format);
+    vsnprintf(text, length + 1, format, args);
+    va_end(args);
+    return text;
+}
+
+/* frees every block of an arena at once, leaving it empty */
+static void arena_free(struct png2gba_arena* arena) {
+    while (arena->blocks) {
+        struct png2gba_arena_block* next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+}
+
+/* files at least this big are mapped, below it mapping and unmapping them
+ * takes longer than reading them in */
+#define MAP_THRESHOLD 65536
+
+int png2gba_map_file(FILE* in, struct png2gba_memory* memory) {
+    struct stat info;
+    memory->offset = 0;
+
+    /* large regular files are mapped as they are, with no copy through stdio */
+    int regular = fstat(fileno(in), &info) == 0 && S_ISREG(info.st_mode);
+    if (regular && info.st_size >= MAP_THRESHOLD) {
+        void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fileno(in), 0);
+        if (data != MAP_FAILED) {
+            memory->data = data;
+            memory->size = info.st_size;
+            memory->kind = PNG2GBA_MEMORY_MAPPED;
+            fclose(in);
+            return PNG2GBA_OK;
+        }
+    }
+
+    /* anything else is read in, growing the memory as it goes, while a
+     * small file fits at once */
+    size_t capacity = regular ? (size_t) info.st_size + 1 : FLUSH_SIZE;
+    size_t size = 0, count;
+    unsigned char* data = NULL;
+    do {
+        if (!data || size == capacity) {
+            capacity = data ? capacity * 2 : capacity;
+            data = realloc(data, capacity);
+            if (!data) {
+                fprintf(stderr, "Error: Out of memory!\n");
+                abort();
+            }
+        }
+        count = fread(data + size, 1, capacity - size, in);
+        size += count;
+    } while (count > 0);
+    int error = ferror(in) ? PNG2GBA_ERROR_READ : PNG2GBA_OK;
+    fclose(in);
+    if (error) {
+        free(data);
+        return error;
+    }
+    memory->data = data;
+    memory->size = size;
+    memory->kind = PNG2GBA_MEMORY_ALLOCATED;
+    return PNG2GBA_OK;
+}
+
+void png2gba_unmap(struct png2gba_memory* memory) {
+    if (memory->kind == PNG2GBA_MEMORY_MAPPED) {
+        munmap((void*) memory->data, memory->size);
+    } else if (memory->kind == PNG2GBA_MEMORY_ALLOCATED) {
+        free((void*) memory->data);
+    }
+    memory->data = NULL;
+    memory->size = 0;
+    memory->kind = PNG2GBA_MEMORY_BORROWED;
+}
+
+/* frees an image, its rows and everything its conversions used, along with
+ * the memory it was read from unless that is borrowed */
+void png2gba_free_image(struct png2gba_image* image) {
+    arena_free(&image->arena);
+    if (image->png_reader) {
+        png_destroy_read_struct(&image->png_reader, &image->png_info, NULL);
+    }
+    png2gba_unmap(&image->memory);
+    free(image);
+}
+
+/* libpng errors come back to read_png as error codes, so nothing is printed */
+static void png_failed(png_structp png_reader, png_const_charp message) {
+    (void) message;
+    png_longjmp(png_reader, 1);
+}
+static void png_warned(png_structp png_reader, png_const_charp message) {
+    (void) png_reader;
+    (void) message;
+}
+
+/* the libpng read function for an image in memory */
+static void read_memory(png_structp png_reader, png_bytep data, png_size_t length) {
+    struct png2gba_memory* memory = png_get_io_ptr(png_reader);
+    if (length > memory->size - memory->offset) {
+        png_error(png_reader, "Unexpected end of PNG data");
+    }
+    memcpy(data, memory->data + memory->offset, length);
+    memory->offset += length;
+}
+
+/* load the png image from memory, which the image takes over, or with
+ * streaming just its header if the rows can be read in order */
+static struct png2gba_image* read_png(struct png2gba_context* context,
+        struct png2gba_memory* memory) {
+    double start = now_seconds();
+    memset(&context->timings, 0, sizeof(struct png2gba_timings));
+    context->timings.start = start;
+
+    /* check the PNG signature */
+    if (memory->size < 8 || png_sig_cmp(memory->data, 0, 8)) {
+        png2gba_unmap(memory);
+        fail(context, PNG2GBA_ERROR_NOT_PNG);
+        return NULL;
+    }
+
+    /* setup structs for reading */
+    png_structp png_reader = png_create_read_struct(PNG_LIBPNG_VER_STRING,
+            NULL, png_failed, png_warned);
+    png_infop png_info = png_reader ? png_create_info_struct(png_reader) : NULL;
+    if (!png_info) {
+        png_destroy_read_struct(&png_reader, NULL, NULL);
+        png2gba_unmap(memory);
+        fail(context, PNG2GBA_ERROR_READ);
+        return NULL;
+    }
+
+    /* allocate an image, which now owns the memory and the reader */
+    struct png2gba_image* image = calloc(1, sizeof(struct png2gba_image));
+    image->memory = *memory;
+    image->memory.offset = 8;
+    image->png_reader = png_reader;
+    image->png_info = png_info;
+    if (setjmp(png_jmpbuf(png_reader))) {
+        png2gba_free_image(image);
+        fail(context, PNG2GBA_ERROR_READ);
+        return NULL;
+    }
+
+    /* read in the header information */
+    png_set_read_fn(png_reader, &image->memory, read_memory);
+    png_set_sig_bytes(png_reader, 8);
+    png_read_info(png_reader, png_info);
+    image->w = png_get_image_width(png_reader, png_info);
+    image->h = png_get_image_height(png_reader, png_info);
+    image->color_type = png_get_color_type(png_reader, png_info);
+    image->bit_depth = png_get_bit_depth(png_reader, png_info);
+
+    /* palette images keep their indices, unpacked to a byte each, and their
+     * palette, while gray and 16-bit images are made into 8-bit RGB */
+    if (image->color_type == PNG_COLOR_TYPE_PALETTE) {
+        png_colorp plte;
+        int i;
+        png_set_packing(png_reader);
+        if (png_get_PLTE(png_reader, png_info, &plte, &image->plte_size)) {
+            for (i = 0; i < image->plte_size; i++) {
+                image->plte[i] = (plte[i].red >> 3) | ((plte[i].green >> 3) << 5)
+                    | ((plte[i].blue >> 3) << 10);
+            }
+        }
+    }
+    if (!(image->color_type & PNG_COLOR_MASK_COLOR)) {
+        png_set_expand_gray_1_2_4_to_8(png_reader);
+        png_set_gray_to_rgb(png_reader);
+    }
+    if (image->bit_depth == 16) {
+        png_set_strip_16(png_reader);
+    }
+    png_set_interlace_handling(png_reader);
+    png_read_update_info(png_reader, png_info);
+
+    /* check format */
+    if (png_get_color_type(png_reader, png_info) == PNG_COLOR_TYPE_RGB) {
+        image->channels = 3;
+    } else if (png_get_color_type(png_reader,png_info)==PNG_COLOR_TYPE_RGBA) {
+        image->channels = 4;
+    } else if (png_get_color_type(png_reader, png_info) == PNG_COLOR_TYPE_PALETTE) {
+        image->channels = 1;
+        image->indexed = 1;
+    } else {
+        png2gba_free_image(image);
+        fail(context, PNG2GBA_ERROR_COLOR_TYPE);
+        return NULL;
+    }
+
+    /* interlaced rows don't come in order, so those are read whole, as are
+     * images which are compressed or split into palette banks */
+    if (context->options.stream && !context->options.compress && !context->options.bpp4
+            && png_get_interlace_type(png_reader, png_info) == PNG_INTERLACE_NONE) {
+        context->timings.decode = now_seconds() - start;
+        return image;
+    }
+
+    /* read the actual file, the rows are one block */
+    size_t rowbytes = png_get_rowbytes(png_reader, png_info);
+    image->rows = arena_alloc(&image->arena, sizeof(png_bytep) * image->h);
+    png_bytep pixels = arena_alloc(&image->arena, rowbytes * image->h);
+    int r;
+    for (r = 0; r < image->h; r++) {
+        image->rows[r] = pixels + r * rowbytes;
+    }
+    png_read_image(png_reader, image->rows);
+
+    /* let go of the input and return */
+    png_destroy_read_struct(&image->png_reader, &image->png_info, NULL);
+    png2gba_unmap(&image->memory);
+    context->timings.decode = now_seconds() - start;
+    return image;
+}
+
+struct png2gba_image* png2gba_read_mapped(struct png2gba_context* context,
+        struct png2gba_memory* memory) {
+    return read_png(context, memory);
+}
+
+struct png2gba_image* png2gba_read_file(struct png2gba_context* context, FILE* in) {
+    struct png2gba_memory memory;
+    int error = png2gba_map_file(in, &memory);
+    if (error) {
+        fail(context, error);
+        return NULL;
+    }
+    return read_png(context, &memory);
+}
+
+struct png2gba_image* png2gba_read_memory(struct png2gba_context* context, const void* data,
+        size_t size) {
+    struct png2gba_memory memory = {data, size, 0, PNG2GBA_MEMORY_BORROWED};
+    return read_png(context, &memory);
+}
+
+/* reads the next count rows of a streamed image */
+static int read_png_rows(struct png2gba_image* image, png_bytep* rows, int count) {
+    if (setjmp(png_jmpbuf(image->png_reader))) {
+        return PNG2GBA_ERROR_READ;
+    }
+    png_read_rows(image->png_reader, rows, NULL, count);
+    return PNG2GBA_OK;
+}
+
+/* empty a palette, leaving only the transparent color in slot 0 */
+void png2gba_init_palette(struct png2gba_palette* palette, unsigned short colorkey) {
+    memset(palette->colors, 0, PNG2GBA_PALETTE_SIZE * sizeof(unsigned short));
+    memset(palette->index, 0xff, PNG2GBA_COLOR_SPACE_SIZE * sizeof(short));
+    palette->colors[0] = colorkey;
+    palette->index[colorkey] = 0;
+    palette->size = 1;
+}
+
+/* inserts a color into a palette and returns the index, or return
+ * the existing index if the color is already there, or -1 if it is full */
+static int insert_palette(unsigned short color, struct png2gba_palette* palette) {
+    /* if it is already there, return it */
+    short index = palette->index[color];
+    if (index >= 0) {
+        return index;
+    }
+
+    /* if the palette is full, we're in trouble */
+    if (palette->size == PNG2GBA_PALETTE_SIZE) {
+        return -1;
+    }
+
+    /* it was not found, so add it */
+    palette->colors[palette->size] = color;
+    palette->index[color] = palette->size;
+
+    /* increment palette size and return the index */
+    palette->size++;
+    return palette->size - 1;
+}
+
+/* split a 15-bit color into its 5-bit components */
+#define COLOR_R(c) ((c) & 0x1f)
+#define COLOR_G(c) (((c) >> 5) & 0x1f)
+#define COLOR_B(c) (((c) >> 10) & 0x1f)
+
+/* a distinct color of an image being quantized and how often it is used,
+ * along with the key it is currently being sorted by */
+struct ColorCount {
+    unsigned short color;
+    unsigned int count;
+    unsigned int key;
+};
+
+/* a box of colors in the median cut, covering a range of the color array */
+struct ColorBox {
+    int start, end;
+    int axis, range;
+};
+
+/* compares two colors by their sorting keys */
+static int compare_colors(const void* a, const void* b) {
+    unsigned int ka = ((const struct ColorCount*) a)->key;
+    unsigned int kb = ((const struct ColorCount*) b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+/* finds the widest component of a box of colors */
+static void shrink_box(struct ColorBox* box, struct ColorCount* colors) {
+    int lo[3] = {31, 31, 31}, hi[3] = {0, 0, 0};
+    int i, a;
+    for (i = box->start; i < box->end; i++) {
+        for (a = 0; a < 3; a++) {
+            int v = (colors[i].color >> (a * 5)) & 0x1f;
+            if (v < lo[a]) lo[a] = v;
+            if (v > hi[a]) hi[a] = v;
+        }
+    }
+    box->axis = 0;
+    box->range = -1;
+    for (a = 0; a < 3; a++) {
+        if (hi[a] - lo[a] > box->range) {
+            box->range = hi[a] - lo[a];
+            box->axis = a;
+        }
+    }
+}
+
+/* finds the palette slot closest to a color, skipping the transparent slot
+ * so opaque pixels never become see-through, the palette components are
+ * laid out in arrays padded to a multiple of 8 so 8 slots can be tested at
+ * once */
+static int nearest_color(unsigned short color, short* pr, short* pg, short* pb, int size) {
+    int r = COLOR_R(color), g = COLOR_G(color), b = COLOR_B(color);
+    int best = 1;
+    int i = 1;
+
+#ifdef __SSE2__
+    if (size > 8) {
+        __m128i vr = _mm_set1_epi16(r), vg = _mm_set1_epi16(g), vb = _mm_set1_epi16(b);
+        __m128i best_dist = _mm_set1_epi16(0x7fff);
+        __m128i best_index = _mm_setzero_si128();
+        __m128i index = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+        __m128i step = _mm_set1_epi16(8);
+        for (i = 0; i < size; i += 8) {
+            __m128i dr = _mm_sub_epi16(_mm_loadu_si128((__m128i*) (pr + i)), vr);
+            __m128i dg = _mm_sub_epi16(_mm_loadu_si128((__m128i*) (pg + i)), vg);
+            __m128i db = _mm_sub_epi16(_mm_loadu_si128((__m128i*) (pb + i)), vb);
+            __m128i dist = _mm_add_epi16(_mm_mullo_epi16(dr, dr),
+                    _mm_add_epi16(_mm_mullo_epi16(dg, dg), _mm_mullo_epi16(db, db)));
+            __m128i closer = _mm_cmplt_epi16(dist, best_dist);
+            best_dist = _mm_min_epi16(dist, best_dist);
+            best_index = _mm_or_si128(_mm_and_si128(closer, index),
+                    _mm_andnot_si128(closer, best_index));
+            index = _mm_add_epi16(index, step);
+        }
+
+        /* pick the closest of the 8 lanes, preferring the lowest slot */
+        short dists[8], indices[8];
+        _mm_storeu_si128((__m128i*) dists, best_dist);
+        _mm_storeu_si128((__m128i*) indices, best_index);
+        int best_lane = 0;
+        for (i = 1; i < 8; i++) {
+            if (dists[i] < dists[best_lane] || (dists[i] == dists[best_lane]
+                        && indices[i] < indices[best_lane])) {
+                best_lane = i;
+            }
+        }
+        return indices[best_lane];
+    }
+#endif
+
+    int best_dist = 0x7fff;
+    for (; i < size; i++) {
+        int dr = pr[i] - r, dg = pg[i] - g, db = pb[i] - b;
+        int dist = dr * dr + dg * dg + db * db;
+        if (dist < best_dist) {
+            best_dist = dist;
+            best = i;
+        }
+    }
+    return best;
+}
+
+/* reduces the colors of an image to what fits in the palette using a median
+ * cut over its 15-bit colors, the chosen colors are added to the palette and
+ * every other color of the image is indexed to its nearest palette slot, so
+ * that insert_palette finds all of them afterwards */
+static void quantize_image(unsigned short* colors_in, int count, struct png2gba_palette* palette) {
+    /* histogram the colors which are not already in the palette */
+    unsigned int* histogram = calloc(PNG2GBA_COLOR_SPACE_SIZE, sizeof(unsigned int));
+    int i;
+    for (i = 0; i < count; i++) {
+        histogram[colors_in[i]]++;
+    }
+    struct ColorCount* colors = malloc(sizeof(struct ColorCount) * PNG2GBA_COLOR_SPACE_SIZE);
+    int num_colors = 0;
+    for (i = 0; i < PNG2GBA_COLOR_SPACE_SIZE; i++) {
+        if (histogram[i] && palette->index[i] < 0) {
+            colors[num_colors].color = i;
+            colors[num_colors].count = histogram[i];
+            num_colors++;
+        }
+    }
+    free(histogram);
+
+    /* if everything fits there is nothing to do */
+    int free_slots = PNG2GBA_PALETTE_SIZE - palette->size;
+    if (num_colors <= free_slots) {
+        free(colors);
+        return;
+    }
+    /* split the widest box at its weighted median until we run out of slots */
+    struct ColorBox boxes[PNG2GBA_PALETTE_SIZE];
+    int num_boxes = 0;
+    if (free_slots > 0) {
+        boxes[0].start = 0;
+        boxes[0].end = num_colors;
+        shrink_box(&boxes[0], colors);
+        num_boxes = 1;
+    }
+    while (num_boxes > 0 && num_boxes < free_slots) {
+        int widest = 0;
+        for (i = 1; i < num_boxes; i++) {
+            if (boxes[i].range > boxes[widest].range) {
+                widest = i;
+            }
+        }
+        struct ColorBox* box = &boxes[widest];
+        if (box->range <= 0) {
+            break;
+        }
+
+        /* sort on the widest component, then the whole color */
+        for (i = box->start; i < box->end; i++) {
+            colors[i].key = (((colors[i].color >> (box->axis * 5)) & 0x1f) << 15)
+                | colors[i].color;
+        }
+        qsort(colors + box->start, box->end - box->start,
+                sizeof(struct ColorCount), compare_colors);
+        unsigned long total = 0, half = 0;
+        for (i = box->start; i < box->end; i++) {
+            total += colors[i].count;
+        }
+        int split = box->start;
+        while (split < box->end - 1 && half + colors[split].count <= total / 2) {
+            half += colors[split].count;
+            split++;
+        }
+        if (split == box->start) {
+            split++;
+        }
+
+        boxes[num_boxes].start = split;
+        boxes[num_boxes].end = box->end;
+        box->end = split;
+        shrink_box(box, colors);
+        shrink_box(&boxes[num_boxes], colors);
+        num_boxes++;
+    }
+
+    /* each box contributes its weighted average color */
+    for (i = 0; i < num_boxes; i++) {
+        unsigned long sum_r = 0, sum_g = 0, sum_b = 0, total = 0;
+        int j;
+        for (j = boxes[i].start; j < boxes[i].end; j++) {
+            sum_r += COLOR_R(colors[j].color) * colors[j].count;
+            sum_g += COLOR_G(colors[j].color) * colors[j].count;
+            sum_b += COLOR_B(colors[j].color) * colors[j].count;
+            total += colors[j].count;
+        }
+        unsigned short color = ((sum_b + total / 2) / total) << 10;
+        color += ((sum_g + total / 2) / total) << 5;
+        color += (sum_r + total / 2) / total;
+        palette->colors[palette->size] = color;
+        if (palette->index[color] < 0) {
+            palette->index[color] = palette->size;
+        }
+        palette->size++;
+    }
+
+    /* index every remaining color of the image to the nearest slot */
+    short pr[PNG2GBA_PALETTE_SIZE + 8], pg[PNG2GBA_PALETTE_SIZE + 8], pb[PNG2GBA_PALETTE_SIZE + 8];
+    int padded = (palette->size + 7) & ~7;
+    for (i = 0; i < padded; i++) {
+        /* the transparent slot and the padding are put out of reach */
+        if (i == 0 || i >= palette->size) {
+            pr[i] = pg[i] = pb[i] = 100;
+        } else {
+            pr[i] = COLOR_R(palette->colors[i]);
+            pg[i] = COLOR_G(palette->colors[i]);
+            pb[i] = COLOR_B(palette->colors[i]);
+        }
+    }
+    for (i = 0; i < num_colors; i++) {
+        if (palette->index[colors[i].color] < 0) {
+            palette->index[colors[i].color] = nearest_color(colors[i].color,
+                    pr, pg, pb, palette->size);
+        }
+    }
+    free(colors);
+}
+
+unsigned short png2gba_hex24_to_15(char* hex24) {
+    /* skip the # sign */
+    hex24++;
+
+    /* break off the pieces */
+    char rs[3], gs[3], bs[3];
+    rs[0] = *hex24++;
+    rs[1] = *hex24++;
+    rs[2] = '\0';
+    gs[0] = *hex24++;
+    gs[1] = *hex24++;
+    gs[2] = '\0';
+    bs[0] = *hex24++;
+    bs[1] = *hex24++;
+    bs[2] = '\0';
+
+    /* convert from hex string to int */
+    int r = strtol(rs, NULL, 16);
+    int g = strtol(gs, NULL, 16);
+    int b = strtol(bs, NULL, 16);
+
+    /* build the full 15 bit short */
+    unsigned short color = (b >> 3) << 10;
+    color += (g >> 3) << 5;
+    color += (r >> 3);
+
+    return color;
+}
+
+char* png2gba_get_output_name(char* output_file_name_option, char* input_name,
+        const char* extension){
+    char* output_name;
+    /* if none specified use input name with the extension of the format */
+    if (output_file_name_option) {
+        input_name = output_file_name_option;
+        extension = "";
+    }
+    /* if the name contains directories, like ../test1 or
+     * data/images/bg1 or something, get just the base name */
+    while (strstr(input_name, "/")) {
+        input_name = strstr(input_name, "/") + 1;
+    }
+    output_name = malloc(sizeof(char) * (strlen(input_name) + strlen(extension) + 1));
+    sprintf(output_name, "%s%s", input_name, extension);
+    return output_name;
+}
+
+/* the two hex digits of every byte value, in upper and lower case */
+static char hex_upper[256][2];
+static char hex_lower[256][2];
+
+/* fills in the hex digit tables, must be called before writing output */
+static void init_hex_tables() {
+    const char* upper = "0123456789ABCDEF";
+    const char* lower = "0123456789abcdef";
+    int i;
+    for (i = 0; i < 256; i++) {
+        hex_upper[i][0] = upper[i >> 4];
+        hex_upper[i][1] = upper[i & 0xf];
+        hex_lower[i][0] = lower[i >> 4];
+        hex_lower[i][1] = lower[i & 0xf];
+    }
+}
+
+/* makes sure there is room for at least count more bytes in a buffer and
+ * returns where they go */
+char* png2gba_buffer_reserve(struct png2gba_buffer* buffer, size_t count) {
+    if (buffer->size + count > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : FLUSH_SIZE;
+        while (capacity < buffer->size + count) {
+            capacity *= 2;
+        }
+        buffer->data = realloc(buffer->data, capacity);
+        if (!buffer->data) {
+            fprintf(stderr, "Error: Out of memory!\n");
+            abort();
+        }
+        buffer->capacity = capacity;
+    }
+    return buffer->data + buffer->size;
+}
+
+/* appends a string to a buffer */
+static void buffer_puts(struct png2gba_buffer* buffer, const char* text) {
+    size_t length = strlen(text);
+    memcpy(png2gba_buffer_reserve(buffer, length), text, length);
+    buffer->size += length;
+}
+
+/* appends formatted text to a buffer, only used for the few header lines */
+static void buffer_printf(struct png2gba_buffer* buffer, const char* format, ...) {
+    va_list list;
+    va_start(list, format);
+    int length = vsnprintf(NULL, 0, format, list);
+    va_end(list);
+
+    va_start(list, format);
+    vsnprintf(png2gba_buffer_reserve(buffer, length + 1), length + 1, format, list);
+    va_end(list);
+    buffer->size += length;
+}
+
+/* appends raw bytes to a buffer */
+void png2gba_buffer_write(struct png2gba_buffer* buffer, const void* data, size_t size) {
+    memcpy(png2gba_buffer_reserve(buffer, size), data, size);
+    buffer->size += size;
+}
+
+/* appends a little endian 16-bit or 32-bit value to a buffer */
+static void buffer_put16(struct png2gba_buffer* buffer, unsigned short value) {
+    unsigned char bytes[2] = {value & 0xff, value >> 8};
+    png2gba_buffer_write(buffer, bytes, 2);
+}
+static void buffer_put32(struct png2gba_buffer* buffer, unsigned int value) {
+    unsigned char bytes[4] = {value & 0xff, (value >> 8) & 0xff,
+        (value >> 16) & 0xff, value >> 24};
+    png2gba_buffer_write(buffer, bytes, 4);
+}
+
+/* writes out whatever is in a buffer to its file and empties it */
+void png2gba_buffer_flush(struct png2gba_buffer* buffer) {
+    if (buffer->size && buffer->file) {
+        fwrite(buffer->data, 1, buffer->size, buffer->file);
+        buffer->written += buffer->size;
+        buffer->size = 0;
+    }
+}
+
+/* writes "0x" and the hex digits of a 16-bit value, returning the end */
+static inline char* put_hex16(char* p, unsigned short value, char table[256][2]) {
+    p[0] = '0';
+    p[1] = 'x';
+    memcpy(p + 2, table[value >> 8], 2);
+    memcpy(p + 4, table[value & 0xff], 2);
+    return p + 6;
+}
+
+/* writes "0x" and the hex digits of a 32-bit value, returning the end */
+static inline char* put_hex32(char* p, uint32_t value, char table[256][2]) {
+    p = put_hex16(p, value >> 16, table);
+    memcpy(p, table[(value >> 8) & 0xff], 2);
+    memcpy(p + 2, table[value & 0xff], 2);
+    return p + 4;
+}
+
+/* writes "0x" and the hex digits of an 8-bit value, returning the end */
+static inline char* put_hex8(char* p, unsigned char value, char table[256][2]) {
+    p[0] = '0';
+    p[1] = 'x';
+    memcpy(p + 2, table[value], 2);
+    return p + 4;
+}
+
+/* builds the upper case include guard for an output file name */
+static char* get_include_guard(struct png2gba_arena* arena, char* output_file_name) {
+    char* include_guard = arena_alloc(arena, strlen(output_file_name)-strlen(".h")+1);
+    //Remove ".h" extension from file name
+    memcpy(include_guard, output_file_name, strlen(output_file_name)-strlen(".h"));
+    include_guard[strlen(output_file_name)-strlen(".h")] = '\0';
+
+    for(size_t i=0; i<strlen(include_guard);i++){
+        include_guard[i] = toupper((unsigned char)include_guard[i]);
+    }
+    return include_guard;
+}
+
+/* the C declaration of an array of count elements of size bytes, packed
+ * into words, aligned for DMA and placed in a section as the options ask,
+ * arrays going into RAM can't be const as the section is writable */
+static char* array_declaration(struct png2gba_arena* arena, struct png2gba_options* options,
+        const char* name, const char* table, const char* dimensions, int count,
+        int size, int aligned) {
+    const char* types[] = {"", "char", "short", "", "int"};
+    if (options->words) {
+        count = (count * size + 3) / 4;
+        size = 4;
+    }
+    char* attributes = "";
+    if (options->words || options->align || aligned) {
+        attributes = options->section != PNG2GBA_SECTION_ROM
+            ? arena_printf(arena, " __attribute__((aligned(4), section(\"%s\")))",
+                    png2gba_section_names[options->section])
+            : " __attribute__((aligned(4)))";
+    } else if (options->section != PNG2GBA_SECTION_ROM) {
+        attributes = arena_printf(arena, " __attribute__((section(\"%s\")))",
+                png2gba_section_names[options->section]);
+    }
+    return arena_printf(arena, "%sunsigned %s %s_%s %s[%d]%s",
+            options->section == PNG2GBA_SECTION_ROM ? "const " : "", types[size], name, table,
+            dimensions, count, attributes);
+}
+
+/* writes little endian bytes as C array elements of 32-bit words, with the
+ * last word padded with zeroes, carrying on the line from where the last
+ * call left off */
+static void write_words(struct png2gba_buffer* out, const unsigned char* bytes, size_t size,
+        int* words_this_line) {
+    size_t i;
+    for (i = 0; i < size; i += 4) {
+        uint32_t word = 0;
+        size_t b;
+        for (b = 0; b < 4 && i + b < size; b++) {
+            word |= (uint32_t) bytes[i + b] << (b * 8);
+        }
+
+        /* room for the indent, the value, the comma and a newline */
+        char* p = png2gba_buffer_reserve(out, 4 + 10 + 2 + 1);
+        char* start = p;
+        if (*words_this_line == 0) {
+            memcpy(p, "    ", 4);
+            p += 4;
+        }
+        p = put_hex32(p, word, hex_upper);
+        memcpy(p, ", ", 2);
+        p += 2;
+        (*words_this_line)++;
+        if (*words_this_line >= MAX_ROW32) {
+            *p++ = '\n';
+            *words_this_line = 0;
+        }
+        out->size += p - start;
+        if (out->size >= FLUSH_SIZE) {
+            png2gba_buffer_flush(out);
+        }
+    }
+}
+
+/* writes the colors of a palette, all PNG2GBA_PALETTE_SIZE of them, as they are or
+ * packed into words */
+static void write_palette_colors(struct png2gba_buffer* palette_out,
+        struct png2gba_palette* color_palette, int words) {
+    if (words) {
+        struct png2gba_buffer raw = {NULL, 0, 0, NULL, 0};
+        int words_this_line = 0;
+        png2gba_write_binary_palette(&raw, color_palette);
+        write_words(palette_out, (unsigned char*) raw.data, raw.size, &words_this_line);
+        free(raw.data);
+        return;
+    }
+
+    /* each line is at most 9 colors of 8 characters plus the indent */
+    char* p = png2gba_buffer_reserve(palette_out,
+            PNG2GBA_PALETTE_SIZE * 8 + (PNG2GBA_PALETTE_SIZE / 9 + 1) * 5);
+    char* start = p;
+    int colors_this_line = 0;
+    int i;
+    for (i = 0; i < PNG2GBA_PALETTE_SIZE; i++) {
+        if (colors_this_line == 0) {
+            memcpy(p, "    ", 4);
+            p += 4;
+        }
+        p = put_hex16(p, color_palette->colors[i], hex_lower);
+        if (i != (PNG2GBA_PALETTE_SIZE - 1)) {
+            memcpy(p, ", ", 2);
+            p += 2;
+        }
+        colors_this_line++;
+        if (colors_this_line > 8) {
+            *p++ = '\n';
+            colors_this_line = 0;
+        }
+    }
+    palette_out->size += p - start;
+}
+
+/* writes a complete palette file into a buffer, for a palette which does
+ * not belong to the conversion of just one image */
+static void write_palette_file(struct png2gba_buffer* palette_out, struct png2gba_options* options,
+        char* output_file_name, char* name, struct png2gba_palette* color_palette) {
+    struct png2gba_arena arena = {NULL};
+    char* include_guard = get_include_guard(&arena, output_file_name);
+
+    /* if the name contains directories, get just the base name */
+    while (strstr(name, "/")) {
+        name = strstr(name, "/") + 1;
+    }
+
+    buffer_printf(palette_out, "/* palette_%s\n * generated by png2gba program */\n\n", output_file_name);
+    buffer_printf(palette_out, "//This palette file belongs to the file %s.h\n", name);
+    buffer_printf(palette_out, "#pragma once\n#ifndef PALETTE_%s_H\n#define PALETTE_%s_H\n\n#include \"%s\"\n\n", include_guard, include_guard, output_file_name);
+    buffer_printf(palette_out, "#define %s_palette_entries %d\n\n", name, 1);
+    buffer_printf(palette_out, "%s = {\n", array_declaration(&arena, options, name,
+                "palette", "", PNG2GBA_PALETTE_SIZE, 2, 0));
+    write_palette_colors(palette_out, color_palette, options->words);
+    buffer_puts(palette_out, "\n};\n\n#endif");
+    arena_free(&arena);
+}
+
+/* writes a complete palette file for a palette shared by a batch, this is
+ * done once all of the files have been converted into it */
+void png2gba_write_shared_palette(FILE* palette_file, struct png2gba_options* options,
+        char* output_file_name, char* name, struct png2gba_palette* color_palette) {
+    struct png2gba_buffer buffer = {NULL, 0, 0, palette_file, 0};
+    write_palette_file(&buffer, options, output_file_name, name, color_palette);
+    png2gba_buffer_flush(&buffer);
+    free(buffer.data);
+}
+
+/* writes the colors of a palette as raw little endian data */
+void png2gba_write_binary_palette(struct png2gba_buffer* palette_out,
+        struct png2gba_palette* color_palette) {
+    int i;
+    for (i = 0; i < PNG2GBA_PALETTE_SIZE; i++) {
+        buffer_put16(palette_out, color_palette->colors[i]);
+    }
+}
+
+/* pads a buffer with zeroes up to a multiple of 4 bytes */
+static void buffer_align4(struct png2gba_buffer* buffer) {
+    while (buffer->size & 3) {
+        png2gba_buffer_write(buffer, "", 1);
+    }
+}
+
+/* adds an extra table to an output and returns its buffer */
+struct png2gba_buffer* png2gba_add_table(struct png2gba_output* output, const char* table_name) {
+    struct png2gba_buffer* table = &output->tables[output->num_tables];
+    output->table_names[output->num_tables] = table_name;
+    output->num_tables++;
+    return table;
+}
+
+/* frees everything in an output, leaving it empty */
+void png2gba_free_output(struct png2gba_output* output) {
+    int i;
+    free(output->data.data);
+    free(output->palette.data);
+    for (i = 0; i < output->num_tables; i++) {
+        free(output->tables[i].data);
+    }
+    memset(output, 0, sizeof(struct png2gba_output));
+}
+
+/* writes values as C array elements, either 8-bit or 16-bit wide, carrying
+ * on the line from where the last call left off */
+static void write_values(struct png2gba_buffer* out, unsigned short* values, int count,
+        int wide, int* colors_this_line) {
+    int max_row = wide ? MAX_ROW16 : MAX_ROW8;
+    int i;
+    for (i = 0; i < count; i++) {
+        /* room for the indent, the value, the comma and a newline */
+        char* p = png2gba_buffer_reserve(out, 4 + 6 + 2 + 1);
+        char* start = p;
+
+        /* print leading space if first of line */
+        if (*colors_this_line == 0) {
+            memcpy(p, "    ", 4);
+            p += 4;
+        }
+
+        /* print color directly, or palette index */
+        if (wide) {
+            p = put_hex16(p, values[i], hex_upper);
+        } else {
+            p = put_hex8(p, values[i], hex_upper);
+        }
+
+        memcpy(p, ", ", 2);
+        p += 2;
+
+        /* increment colors on line unless too many */
+        (*colors_this_line)++;
+        if (*colors_this_line >= max_row) {
+            *p++ = '\n';
+            *colors_this_line = 0;
+        }
+        out->size += p - start;
+
+        /* write out large pieces as we go */
+        if (out->size >= FLUSH_SIZE) {
+            png2gba_buffer_flush(out);
+        }
+    }
+}
+
+/* writes values as raw little endian data, either 8-bit or 16-bit wide */
+static void write_binary_values(struct png2gba_buffer* out, unsigned short* values, int count,
+        int wide) {
+    int i;
+    for (i = 0; i < count; i++) {
+        if (wide) {
+            buffer_put16(out, values[i]);
+        } else {
+            unsigned char value = values[i];
+            png2gba_buffer_write(out, &value, 1);
+        }
+        if (out->size >= FLUSH_SIZE) {
+            png2gba_buffer_flush(out);
+        }
+    }
+}
+
+/* writes values as C array elements as they are, or packed into words of
+ * their little endian bytes, every call but the last has to end on a whole
+ * word since only the last word is padded */
+static void write_c_values(struct png2gba_buffer* out, unsigned short* values, int count,
+        int wide, int words, int* colors_this_line) {
+    if (words) {
+        struct png2gba_buffer raw = {NULL, 0, 0, NULL, 0};
+        write_binary_values(&raw, values, count, wide);
+        write_words(out, (unsigned char*) raw.data, raw.size, colors_this_line);
+        free(raw.data);
+    } else {
+        write_values(out, values, count, wide, colors_this_line);
+    }
+}
+
+/* the number of values in one tile */
+#define TILE_VALUES (PNG2GBA_TILE_SIZE * PNG2GBA_TILE_SIZE)
+
+/* the screen entry bits for a flipped tile */
+#define FLIP_H 0x400
+#define FLIP_V 0x800
+
+
+/* copies a tile, flipping it horizontally and/or vertically */
+static void flip_tile(unsigned short* dest, const unsigned short* tile, int flip) {
+    int r, c;
+    for (r = 0; r < PNG2GBA_TILE_SIZE; r++) {
+        int sr = (flip & FLIP_V) ? PNG2GBA_TILE_SIZE - 1 - r : r;
+        for (c = 0; c < PNG2GBA_TILE_SIZE; c++) {
+            int sc = (flip & FLIP_H) ? PNG2GBA_TILE_SIZE - 1 - c : c;
+            dest[r * PNG2GBA_TILE_SIZE + c] = tile[sr * PNG2GBA_TILE_SIZE + sc];
+        }
+    }
+}
+
+/* hashes the values of one tile */
+static uint64_t hash_tile(const unsigned short* tile) {
+    uint64_t hash = 0;
+    int i;
+    for (i = 0; i < TILE_VALUES; i += 4) {
+        uint64_t word = tile[i] | ((uint64_t) tile[i + 1] << 16)
+            | ((uint64_t) tile[i + 2] << 32) | ((uint64_t) tile[i + 3] << 48);
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+/* removes repeated tiles from values, which holds num_tiles tiles in tile
+ * order, a tile which matches an earlier one as is or flipped is dropped,
+ * the unique tiles are moved to the front and map gets the screen entry of
+ * every tile, returns the number of unique tiles */
+static int dedup_tiles(unsigned short* values, int num_tiles, unsigned short* map) {
+    /* an open addressing table of unique tile numbers plus one */
+    int capacity = 1;
+    while (capacity < num_tiles * 2) {
+        capacity *= 2;
+    }
+    int* slots = calloc(capacity, sizeof(int));
+    uint64_t* hashes = malloc(sizeof(uint64_t) * num_tiles);
+    const int flips[4] = {0, FLIP_H, FLIP_V, FLIP_H | FLIP_V};
+    unsigned short flipped[TILE_VALUES];
+    int num_unique = 0;
+    int t, f;
+
+    for (t = 0; t < num_tiles; t++) {
+        unsigned short* tile = values + t * TILE_VALUES;
+        int found = -1;
+
+        /* look for a unique tile this is a flip of */
+        for (f = 0; f < 4 && found < 0; f++) {
+            flip_tile(flipped, tile, flips[f]);
+            uint64_t hash = hash_tile(flipped);
+            int slot = hash & (capacity - 1);
+            while (slots[slot]) {
+                int u = slots[slot] - 1;
+                if (hashes[u] == hash && !memcmp(values + u * TILE_VALUES,
+                            flipped, sizeof(flipped))) {
+                    found = u;
+                    map[t] = u | flips[f];
+                    break;
+                }
+                slot = (slot + 1) & (capacity - 1);
+            }
+        }
+
+        /* otherwise it is a new one */
+        if (found < 0) {
+            uint64_t hash = hash_tile(tile);
+            int slot = hash & (capacity - 1);
+            while (slots[slot]) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            memmove(values + num_unique * TILE_VALUES, tile,
+                    sizeof(unsigned short) * TILE_VALUES);
+            hashes[num_unique] = hash;
+            slots[slot] = num_unique + 1;
+            map[t] = num_unique;
+            num_unique++;
+        }
+    }
+
+    free(slots);
+    free(hashes);
+    return num_unique;
+}
+
+/* the width and height of a screenblock in screen entries */
+#define SCREENBLOCK_SIZE 32
+
+/* lays out a screen map of map_w by map_h entries in rows as the layout
+ * asks, into dest, with where each screenblock or strip starts in index,
+ * screenblocks go in rows and each is padded out to 32x32 entries with
+ * entry 0 so that it can be copied straight into VRAM, returns the number
+ * of entries in dest and sets num_index to the number of starts */
+static int lay_out_map(unsigned short* dest, unsigned int* index, const unsigned short* map,
+        int map_w, int map_h, enum png2gba_layout layout, int* num_index) {
+    int x, y, n = 0;
+    if (layout == PNG2GBA_LAYOUT_SCREENBLOCKS) {
+        int blocks_w = (map_w + SCREENBLOCK_SIZE - 1) / SCREENBLOCK_SIZE;
+        int blocks_h = (map_h + SCREENBLOCK_SIZE - 1) / SCREENBLOCK_SIZE;
+        int bx, by;
+        *num_index = 0;
+        for (by = 0; by < blocks_h; by++) {
+            for (bx = 0; bx < blocks_w; bx++) {
+                index[(*num_index)++] = n;
+                for (y = by * SCREENBLOCK_SIZE; y < (by + 1) * SCREENBLOCK_SIZE; y++) {
+                    for (x = bx * SCREENBLOCK_SIZE; x < (bx + 1) * SCREENBLOCK_SIZE; x++) {
+                        dest[n++] = x < map_w && y < map_h ? map[y * map_w + x] : 0;
+                    }
+                }
+            }
+        }
+    } else if (layout == PNG2GBA_LAYOUT_COLUMNS) {
+        for (x = 0; x < map_w; x++) {
+            index[x] = n;
+            for (y = 0; y < map_h; y++) {
+                dest[n++] = map[y * map_w + x];
+            }
+        }
+        *num_index = map_w;
+    } else {
+        for (y = 0; y < map_h; y++) {
+            index[y] = n;
+            memcpy(dest + n, map + y * map_w, sizeof(unsigned short) * map_w);
+            n += map_w;
+        }
+        *num_index = map_h;
+    }
+    return n;
+}
+
+/* writes 32-bit values as raw little endian data */
+static void write_binary_words(struct png2gba_buffer* out, const unsigned int* values, int count) {
+    int i;
+    for (i = 0; i < count; i++) {
+        buffer_put32(out, values[i]);
+    }
+}
+
+/* 4bpp tiles index one bank of 16 colors, whose slot 0 is transparent */
+#define BANK_SIZE 16
+#define MAX_BANKS (PNG2GBA_PALETTE_SIZE / BANK_SIZE)
+
+/* the screen entry bits holding the bank of a tile */
+#define BANK_SHIFT 12
+
+/* the colors of a tile or a bank besides the transparent one, kept sorted,
+ * along with the bank the colors of a tile went into */
+struct ColorSet {
+    unsigned short colors[BANK_SIZE - 1];
+    int size;
+    int bank;
+};
+
+/* orders color sets with the most colors first, so the hardest to place go
+ * into the banks while they are still empty */
+static int compare_sets(const void* a, const void* b) {
+    const struct ColorSet* sa = *(const struct ColorSet* const*) a;
+    const struct ColorSet* sb = *(const struct ColorSet* const*) b;
+    if (sa->size != sb->size) {
+        return sb->size - sa->size;
+    }
+    return sa < sb ? -1 : sa > sb;
+}
+
+/* counts the colors of a set which are not in a bank yet */
+static int missing_colors(const struct ColorSet* bank, const struct ColorSet* set) {
+    int i = 0, j = 0, missing = 0;
+    while (j < set->size) {
+        if (i < bank->size && bank->colors[i] < set->colors[j]) {
+            i++;
+        } else if (i < bank->size && bank->colors[i] == set->colors[j]) {
+            i++;
+            j++;
+        } else {
+            missing++;
+            j++;
+        }
+    }
+    return missing;
+}
+
+/* adds the colors of a set to a bank, keeping it sorted */
+static void merge_colors(struct ColorSet* bank, const struct ColorSet* set) {
+    struct ColorSet merged;
+    int i = 0, j = 0;
+    merged.size = 0;
+    while (i < bank->size || j < set->size) {
+        if (j == set->size || (i < bank->size && bank->colors[i] < set->colors[j])) {
+            merged.colors[merged.size++] = bank->colors[i++];
+        } else {
+            if (i < bank->size && bank->colors[i] == set->colors[j]) {
+                i++;
+            }
+            merged.colors[merged.size++] = set->colors[j++];
+        }
+    }
+    memcpy(bank->colors, merged.colors, sizeof(merged.colors));
+    bank->size = merged.size;
+}
+
+/* merges the two banks which fit together in the fewest colors, moving the
+ * sets placed so far along with them, returns whether any two fit */
+static int merge_banks(struct ColorSet* bank_colors, int* num_banks,
+        struct ColorSet** placed, int num_placed) {
+    int best_a = -1, best_b = -1, best_size = BANK_SIZE;
+    int a, b, i;
+    for (a = 0; a < *num_banks; a++) {
+        for (b = a + 1; b < *num_banks; b++) {
+            int size = bank_colors[a].size + missing_colors(&bank_colors[a], &bank_colors[b]);
+            if (size < best_size) {
+                best_a = a;
+                best_b = b;
+                best_size = size;
+            }
+        }
+    }
+    if (best_a < 0) {
+        return 0;
+    }
+
+    /* the last bank fills the gap the merged one leaves */
+    int last = *num_banks - 1;
+    merge_colors(&bank_colors[best_a], &bank_colors[best_b]);
+    bank_colors[best_b] = bank_colors[last];
+    for (i = 0; i < num_placed; i++) {
+        if (placed[i]->bank == best_b) {
+            placed[i]->bank = best_a;
+        } else if (placed[i]->bank == last) {
+            placed[i]->bank = best_b;
+        }
+    }
+    (*num_banks)--;
+    return 1;
+}
+
+/* splits the colors of values, which holds num_tiles tiles in tile order,
+ * into as few banks of 16 colors as we can, and replaces every color with
+ * its index in the bank of its tile, which goes into banks
+ *
+ * finding the fewest banks is NP-hard, so tiles with the same colors are
+ * grouped and the groups are placed greedily, which is fast enough for the
+ * biggest maps
+ *
+ * the palette gets the banks one after another, it has to hold the
+ * transparent color in slot 0, returns the number of banks or an error
+ * code as a negative number */
+static int assign_banks(unsigned short* values, int num_tiles,
+        struct png2gba_palette* palette, unsigned short* banks) {
+    unsigned short colorkey = palette->colors[0];
+    struct ColorSet* sets = malloc(sizeof(struct ColorSet) * num_tiles);
+    int* tile_sets = malloc(sizeof(int) * num_tiles);
+    int num_sets = 0;
+    int t, i, b;
+
+    /* an open addressing table of distinct color sets plus one */
+    int capacity = 1;
+    while (capacity < num_tiles * 2) {
+        capacity *= 2;
+    }
+    int* slots = calloc(capacity, sizeof(int));
+
+    for (t = 0; t < num_tiles; t++) {
+        unsigned short* tile = values + t * TILE_VALUES;
+        struct ColorSet* set = &sets[num_sets];
+        set->size = 0;
+        set->bank = -1;
+
+        /* gather the distinct colors of the tile in order */
+        for (i = 0; i < TILE_VALUES; i++) {
+            unsigned short color = tile[i];
+            int at = 0;
+            if (color == colorkey) {
+                continue;
+            }
+            while (at < set->size && set->colors[at] < color) {
+                at++;
+            }
+            if (at < set->size && set->colors[at] == color) {
+                continue;
+            }
+            if (set->size == BANK_SIZE - 1) {
+                free(sets);
+                free(tile_sets);
+                free(slots);
+                return -PNG2GBA_ERROR_TILE_COLORS;
+            }
+            memmove(set->colors + at + 1, set->colors + at,
+                    sizeof(unsigned short) * (set->size - at));
+            set->colors[at] = color;
+            set->size++;
+        }
+
+        /* and share the set with any earlier tile which has the same */
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (i = 0; i < set->size; i++) {
+            hash = (hash ^ set->colors[i]) * 0x100000001b3ULL;
+        }
+        int slot = hash & (capacity - 1);
+        while (slots[slot]) {
+            struct ColorSet* other = &sets[slots[slot] - 1];
+            if (other->size == set->size && !memcmp(other->colors, set->colors,
+                        sizeof(unsigned short) * set->size)) {
+                break;
+            }
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (!slots[slot]) {
+            slots[slot] = ++num_sets;
+        }
+        tile_sets[t] = slots[slot] - 1;
+    }
+    free(slots);
+
+    /* place the sets, largest first, in the bank they share the most colors
+     * with, a set sharing none starts a bank of its own while there are
+     * banks to spare, since unrelated colors crowd out the ones a bank's
+     * other tiles will want, when they run out two are merged if they can,
+     * and once every set is placed the banks are merged for as long as any
+     * two fit together, so there are as few as possible */
+    struct ColorSet** order = malloc(sizeof(struct ColorSet*) * num_sets);
+    struct ColorSet bank_colors[MAX_BANKS];
+    int num_banks = 0;
+    for (i = 0; i < num_sets; i++) {
+        order[i] = &sets[i];
+    }
+    qsort(order, num_sets, sizeof(struct ColorSet*), compare_sets);
+    for (i = 0; i < num_sets; i++) {
+        int best = -1, best_missing = BANK_SIZE;
+        for (b = 0; b < num_banks && best_missing > 0; b++) {
+            int missing = missing_colors(&bank_colors[b], order[i]);
+            if (missing < best_missing && bank_colors[b].size + missing < BANK_SIZE) {
+                best = b;
+                best_missing = missing;
+            }
+        }
+        if (best >= 0 && best_missing == order[i]->size && num_banks < MAX_BANKS) {
+            best = -1;
+        }
+        if (best < 0 && num_banks == MAX_BANKS && merge_banks(bank_colors, &num_banks, order, i)) {
+            i--;
+            continue;
+        }
+        if (best < 0) {
+            if (num_banks == MAX_BANKS) {
+                free(order);
+                free(sets);
+                free(tile_sets);
+                return -PNG2GBA_ERROR_TOO_MANY_BANKS;
+            }
+            best = num_banks++;
+            bank_colors[best].size = 0;
+        }
+        merge_colors(&bank_colors[best], order[i]);
+        order[i]->bank = best;
+    }
+    while (merge_banks(bank_colors, &num_banks, order, num_sets)) {
+    }
+    free(order);
+
+    /* lay the banks out in the palette */
+    png2gba_init_palette(palette, colorkey);
+    for (b = 0; b < num_banks; b++) {
+        palette->colors[b * BANK_SIZE] = colorkey;
+        memcpy(palette->colors + b * BANK_SIZE + 1, bank_colors[b].colors,
+                sizeof(unsigned short) * bank_colors[b].size);
+    }
+    palette->size = num_banks * BANK_SIZE;
+
+    /* and index each tile into its bank */
+    for (t = 0; t < num_tiles; t++) {
+        unsigned short* tile = values + t * TILE_VALUES;
+        struct ColorSet* bank = &bank_colors[sets[tile_sets[t]].bank];
+        banks[t] = sets[tile_sets[t]].bank;
+        for (i = 0; i < TILE_VALUES; i++) {
+            int lo = 0, hi = bank->size - 1;
+            if (tile[i] == colorkey) {
+                tile[i] = 0;
+                continue;
+            }
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (bank->colors[mid] < tile[i]) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            tile[i] = lo + 1;
+        }
+    }
+
+    free(sets);
+    free(tile_sets);
+    return num_banks;
+}
+
+/* packs 4-bit values two to a byte, the left pixel in the low nibble */
+static void pack_nibbles(unsigned short* values, int count) {
+    int i;
+    for (i = 0; i < count / 2; i++) {
+        values[i] = values[i * 2] | (values[i * 2 + 1] << 4);
+    }
+}
+
+/* writes bytes as C array elements, 8-bit wide */
+static void write_bytes(struct png2gba_buffer* out, struct png2gba_buffer* bytes, int words) {
+    int colors_this_line = 0;
+    size_t i;
+    if (words) {
+        write_words(out, (unsigned char*) bytes->data, bytes->size, &colors_this_line);
+        return;
+    }
+    for (i = 0; i < bytes->size; i++) {
+        unsigned short value = (unsigned char) bytes->data[i];
+        write_values(out, &value, 1, 0, &colors_this_line);
+    }
+}
+
+/* the ELF section and symbol constants we need */
+#define ELF_SECTIONS 5
+#define ELF_HEADER_SIZE 52
+#define ELF_SECTION_HEADER_SIZE 40
+#define ELF_SYMBOL_SIZE 16
+
+/* writes one ELF section header */
+static void write_elf_section(struct png2gba_buffer* out, int name, int type, int flags,
+        int offset, int size, int link, int info, int align, int entsize) {
+    buffer_put32(out, name);
+    buffer_put32(out, type);
+    buffer_put32(out, flags);
+    buffer_put32(out, 0);
+    buffer_put32(out, offset);
+    buffer_put32(out, size);
+    buffer_put32(out, link);
+    buffer_put32(out, info);
+    buffer_put32(out, align);
+    buffer_put32(out, entsize);
+}
+
+/* adds a global symbol for some data in .rodata to an ELF object */
+static void add_elf_symbol(struct png2gba_buffer* rodata, struct png2gba_buffer* symtab,
+        struct png2gba_buffer* strtab, char* name, const char* suffix,
+        struct png2gba_buffer* data) {
+    buffer_put32(symtab, strtab->size);
+    buffer_put32(symtab, rodata->size);
+    buffer_put32(symtab, data->size);
+    unsigned char info_other[2] = {0x11, 0};
+    png2gba_buffer_write(symtab, info_other, 2);
+    buffer_put16(symtab, 1);
+
+    buffer_puts(strtab, name);
+    buffer_puts(strtab, "_");
+    png2gba_buffer_write(strtab, suffix, strlen(suffix) + 1);
+
+    png2gba_buffer_write(rodata, data->data, data->size);
+    buffer_align4(rodata);
+}
+
+/* writes a relocatable ARM ELF object holding the converted data in its
+ * .rodata section, or .ewram or .iwram when placed in RAM, with name_data, name_palette (if there is a palette),
+ * a symbol for each extra table and name_width and name_height symbols
+ * for the linker */
+void png2gba_write_elf(FILE* out_file, char* name, struct png2gba_output* output,
+        int width, int height, enum png2gba_section section) {
+    struct png2gba_buffer rodata = {NULL, 0, 0, NULL, 0};
+    struct png2gba_buffer symtab = {NULL, 0, 0, NULL, 0};
+    struct png2gba_buffer strtab = {NULL, 0, 0, NULL, 0};
+    struct png2gba_buffer size = {NULL, 0, 0, NULL, 0};
+    int i;
+
+    /* the null symbol comes first, then the global symbols in .rodata */
+    memset(png2gba_buffer_reserve(&symtab, ELF_SYMBOL_SIZE), 0, ELF_SYMBOL_SIZE);
+    symtab.size += ELF_SYMBOL_SIZE;
+    png2gba_buffer_write(&strtab, "", 1);
+    add_elf_symbol(&rodata, &symtab, &strtab, name, "data", &output->data);
+    if (output->palette.size) {
+        add_elf_symbol(&rodata, &symtab, &strtab, name, "palette", &output->palette);
+    }
+    for (i = 0; i < output->num_tables; i++) {
+        add_elf_symbol(&rodata, &symtab, &strtab, name, output->table_names[i],
+                &output->tables[i]);
+    }
+    buffer_put32(&size, width);
+    add_elf_symbol(&rodata, &symtab, &strtab, name, "width", &size);
+    size.size = 0;
+    buffer_put32(&size, height);
+    add_elf_symbol(&rodata, &symtab, &strtab, name, "height", &size);
+    char shstrtab[] = "\0.rodata\0.symtab\0.strtab\0.shstrtab";
+
+    /* the RAM section names are shorter than .rodata, so they fit in its
+     * place, and those sections are writable */
+    int rodata_flags = 2;
+    if (section != PNG2GBA_SECTION_ROM) {
+        memset(shstrtab + 1, 0, strlen(".rodata"));
+        memcpy(shstrtab + 1, png2gba_section_names[section],
+                strlen(png2gba_section_names[section]));
+        rodata_flags = 3;
+    }
+
+    /* work out where everything goes in the file */
+    int rodata_offset = ELF_HEADER_SIZE;
+    int symtab_offset = rodata_offset + rodata.size;
+    int strtab_offset = symtab_offset + symtab.size;
+    int shstrtab_offset = strtab_offset + strtab.size;
+    int section_offset = (shstrtab_offset + sizeof(shstrtab) + 3) & ~3;
+
+    /* the ELF header, 32-bit little endian ARM EABI version 5 */
+    struct png2gba_buffer out = {NULL, 0, 0, out_file, 0};
+    unsigned char ident[16] = {0x7f, 'E', 'L', 'F', 1, 1, 1};
+    png2gba_buffer_write(&out, ident, 16);
+    buffer_put16(&out, 1);
+    buffer_put16(&out, 40);
+    buffer_put32(&out, 1);
+    buffer_put32(&out, 0);
+    buffer_put32(&out, 0);
+    buffer_put32(&out, section_offset);
+    buffer_put32(&out, 0x05000000);
+    buffer_put16(&out, ELF_HEADER_SIZE);
+    buffer_put16(&out, 0);
+    buffer_put16(&out, 0);
+    buffer_put16(&out, ELF_SECTION_HEADER_SIZE);
+    buffer_put16(&out, ELF_SECTIONS);
+    buffer_put16(&out, ELF_SECTIONS - 1);
+
+    /* the section contents */
+    png2gba_buffer_write(&out, rodata.data, rodata.size);
+    png2gba_buffer_write(&out, symtab.data, symtab.size);
+    png2gba_buffer_write(&out, strtab.data, strtab.size);
+    png2gba_buffer_write(&out, shstrtab, sizeof(shstrtab));
+    buffer_align4(&out);
+
+    /* and the section headers: null, .rodata, .symtab, .strtab, .shstrtab */
+    write_elf_section(&out, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    write_elf_section(&out, 1, 1, rodata_flags, rodata_offset, rodata.size, 0, 0, 4, 0);
+    write_elf_section(&out, 9, 2, 0, symtab_offset, symtab.size, 3, 1, 4,
+            ELF_SYMBOL_SIZE);
+    write_elf_section(&out, 17, 3, 0, strtab_offset, strtab.size, 0, 0, 1, 0);
+    write_elf_section(&out, 25, 3, 0, shstrtab_offset, sizeof(shstrtab), 0, 0, 1, 0);
+    png2gba_buffer_flush(&out);
+
+    free(out.data);
+    free(rodata.data);
+    free(symtab.data);
+    free(strtab.data);
+    free(size.data);
+}
+
+/* replaces every color with its palette index, returns an error code */
+static int index_colors(unsigned short* values, int count, struct png2gba_palette* color_palette) {
+    int i;
+    for (i = 0; i < count; i++) {
+        int index = insert_palette(values[i], color_palette);
+        if (index < 0) {
+            return PNG2GBA_ERROR_TOO_MANY_COLORS;
+        }
+        values[i] = index;
+    }
+    return PNG2GBA_OK;
+}
+
+/* fills in the color of each index of an indexed image */
+static void lookup_colors(struct png2gba_image* image, unsigned short* lookup) {
+    int i;
+    for (i = 0; i < PNG2GBA_PALETTE_SIZE; i++) {
+        lookup[i] = i < image->plte_size ? image->plte[i] : 0;
+    }
+}
+
+/* fills in the palette slot of each index of an indexed image, so that its
+ * pixels never have to be looked up in the palette, the PNG palette is used
+ * as is when it starts with the transparent color and the palette is still
+ * empty, or else its colors are added to the palette, returns whether they
+ * all fit, leaving the palette alone if they don't */
+static int lookup_slots(struct png2gba_image* image, struct png2gba_palette* color_palette,
+        unsigned short* lookup) {
+    unsigned short colorkey = color_palette->colors[0];
+    int as_is = color_palette->size == 1 && image->plte_size && image->plte[0] == colorkey;
+    int i;
+    for (i = 1; as_is && i < image->plte_size; i++) {
+        as_is = image->plte[i] != colorkey;
+    }
+    memset(lookup, 0, sizeof(unsigned short) * PNG2GBA_PALETTE_SIZE);
+
+    if (as_is) {
+        for (i = 1; i < image->plte_size; i++) {
+            color_palette->colors[i] = image->plte[i];
+            if (color_palette->index[image->plte[i]] < 0) {
+                color_palette->index[image->plte[i]] = i;
+            }
+            lookup[i] = i;
+        }
+        color_palette->size = image->plte_size;
+        return 1;
+    }
+
+    /* count the new colors first, a color repeated in the PNG palette is
+     * found by the time it comes up again */
+    int added = 0;
+    for (i = 0; i < image->plte_size; i++) {
+        unsigned short color = image->plte[i];
+        int j = 0;
+        if (color_palette->index[color] >= 0) {
+            continue;
+        }
+        while (image->plte[j] != color) {
+            j++;
+        }
+        added += j == i;
+    }
+    if (color_palette->size + added > PNG2GBA_PALETTE_SIZE) {
+        return 0;
+    }
+    for (i = 0; i < image->plte_size; i++) {
+        lookup[i] = insert_palette(image->plte[i], color_palette);
+    }
+    return 1;
+}
+
+/* converts rows of an image into colors, or the indices of an indexed
+ * image into whatever lookup gives for them, tile order is gathered from a
+ * band of 8 rows which comes from the arena the first time */
+static void convert_image_rows(struct png2gba_image* image, unsigned short* dest,
+        png_bytep* rows, int count, const unsigned short* lookup, int tileize) {
+    if (image->indexed) {
+        png2gba_convert_indexed_rows(dest, rows, image->w, count, lookup, tileize);
+        return;
+    }
+    if (tileize && !image->band) {
+        image->band = arena_alloc(&image->arena,
+                sizeof(unsigned short) * image->w * PNG2GBA_TILE_SIZE);
+    }
+    png2gba_convert_rows(dest, rows, image->w, count, image->channels, tileize, image->band);
+}
+
+/* puts colors in row order into tile order */
+static void order_tiles(unsigned short* dest, const unsigned short* src, int w, int h) {
+    int r, c, tr;
+    for (r = 0; r < h; r += PNG2GBA_TILE_SIZE) {
+        for (c = 0; c < w; c += PNG2GBA_TILE_SIZE) {
+            for (tr = 0; tr < PNG2GBA_TILE_SIZE; tr++) {
+                memcpy(dest, src + (r + tr) * w + c, sizeof(unsigned short) * PNG2GBA_TILE_SIZE);
+                dest += PNG2GBA_TILE_SIZE;
+            }
+        }
+    }
+}
+
+/* the colors of an image shared by all of its conversions, in tile order
+ * with tileize, converted the first time they are needed, or put into the
+ * other order if the image has been converted that way before */
+static unsigned short* shared_colors(struct png2gba_image* image, const unsigned short* lookup,
+        int tileize) {
+    if (!image->colors[tileize]) {
+        image->colors[tileize] = arena_alloc(&image->arena,
+                sizeof(unsigned short) * image->w * image->h);
+        if (tileize && image->colors[0]) {
+            order_tiles(image->colors[1], image->colors[0], image->w, image->h);
+        } else {
+            convert_image_rows(image, image->colors[tileize], image->rows, image->h,
+                    lookup, tileize);
+        }
+    }
+    return image->colors[tileize];
+}
+
+/* reads, converts and writes a streamed image one band of 8 rows at a time,
+ * so only one band is ever in memory, returns an error code */
+static int stream_values(struct png2gba_image* image, struct png2gba_buffer* out,
+        enum png2gba_format format, int words, int tileize,
+        struct png2gba_palette* color_palette, const unsigned short* lookup,
+        int slots, struct png2gba_timings* timings) {
+    int rowbytes = png_get_rowbytes(image->png_reader, image->png_info);
+    png_bytep band = arena_alloc(&image->arena, rowbytes * PNG2GBA_TILE_SIZE);
+    png_bytep rows[PNG2GBA_TILE_SIZE];
+    unsigned short* values = arena_alloc(&image->arena,
+            sizeof(unsigned short) * image->w * PNG2GBA_TILE_SIZE);
+    int colors_this_line = 0;
+    int error = PNG2GBA_OK;
+    int r, i;
+
+    for (i = 0; i < PNG2GBA_TILE_SIZE; i++) {
+        rows[i] = band + i * rowbytes;
+    }
+    for (r = 0; r < image->h; r += PNG2GBA_TILE_SIZE) {
+        int count = image->h - r < PNG2GBA_TILE_SIZE ? image->h - r : PNG2GBA_TILE_SIZE;
+        int num_values = image->w * count;
+        double start = now_seconds();
+        error = read_png_rows(image, rows, count);
+        if (error) {
+            break;
+        }
+        double decoded = now_seconds();
+        convert_image_rows(image, values, rows, count, lookup, tileize);
+        double indexing = now_seconds();
+        if (color_palette && !slots) {
+            error = index_colors(values, num_values, color_palette);
+            if (error) {
+                break;
+            }
+        }
+        double converted = now_seconds();
+        if (format == PNG2GBA_FORMAT_C) {
+            write_c_values(out, values, num_values, !color_palette, words, &colors_this_line);
+        } else {
+            write_binary_values(out, values, num_values, !color_palette);
+        }
+        timings->decode += decoded - start;
+        timings->convert += indexing - decoded;
+        timings->palette += converted - indexing;
+        timings->emit += now_seconds() - converted;
+    }
+    return error;
+}
+
+/* perform the actual conversion from png to gba formats, index is where
+ * the image is in a batch of amount_of_files_to_be_processed, if
+ * shared_palette is given the colors go into it and no palette is written */
+int png2gba_convert(struct png2gba_context* context, struct png2gba_image* image,
+        struct png2gba_output* output, char* name, int index,
+        int amount_of_files_to_be_processed, struct png2gba_palette* shared_palette) {
+    
+    struct png2gba_options* options = &context->options;
+    double start = now_seconds();
+    int palette, tileize;
+    palette = options->palette || options->bpp4;
+    tileize = options->tileize || options->dedup || options->bpp4;
+    char* colorkey = options->colorkey;
+    char* output_option = options->output_file_name;
+    struct png2gba_buffer* out = &output->data;
+    struct png2gba_buffer* palette_out = &output->palette;
+
+    char* index_2d_array_option = "";
+    char beginning_paragraphs[10] = {"{"};
+    char ending_paragraphs[15] = {"};"};
+    char* palette_header1 = ""; 
+    char* palette_header2 = ""; 
+    char* palette_header3 = ""; 
+    char* palette_header4 = ""; 
+    char* palette_header5 = "";
+    char* include_header = "";
+    char* include_guard = "";
+
+    /* tiles have to fit the image exactly */
+    if (tileize && (image->w % PNG2GBA_TILE_SIZE || image->h % PNG2GBA_TILE_SIZE)) {
+        return fail(context, PNG2GBA_ERROR_TILE_SIZE);
+    }
+
+    /* everything for this file comes from the arena of the image, and goes
+     * when the image does */
+    struct png2gba_arena* arena = &image->arena;
+    char* output_name = png2gba_get_output_name(options->output_file_name, name,
+            png2gba_format_extensions[options->format]);
+    char* output_file_name = arena_printf(arena, "%s", output_name);
+    free(output_name);
+
+    include_guard = get_include_guard(arena, output_file_name);
+
+    /* if the name contains directories, like ../test1 or
+     * data/images/bg1 or something, get just the base name */
+    while (strstr(name, "/")) {
+        name = strstr(name, "/") + 1;
+    }
+
+    /* the palette stores up to PNG2GBA_PALETTE_SIZE colors, sub 0 is reserved for
+     * the transparent color */
+    struct png2gba_palette* color_palette = shared_palette;
+    if (!color_palette) {
+        color_palette = arena_alloc(arena, sizeof(struct png2gba_palette));
+        png2gba_init_palette(color_palette, png2gba_hex24_to_15(colorkey));
+    }
+
+    /* an indexed image goes straight to palette slots through its own
+     * palette when it can, and otherwise to colors like any other */
+    unsigned short lookup[PNG2GBA_PALETTE_SIZE];
+    int slots = 0;
+    if (image->indexed) {
+        slots = palette && !options->quantize && !options->bpp4
+            && lookup_slots(image, color_palette, lookup);
+        if (!slots) {
+            lookup_colors(image, lookup);
+        }
+    }
+
+    /* convert the pixel data to colors */
+    int num_values = image->w * image->h;
+    unsigned short* values = NULL;
+    int streaming = !image->rows;
+    if (!streaming && image->share_colors && !slots) {
+        /* shared colors are copied if they are about to be changed */
+        values = shared_colors(image, lookup, tileize);
+        if (palette || options->dedup) {
+            unsigned short* copy = arena_alloc(arena, sizeof(unsigned short) * num_values);
+            memcpy(copy, values, sizeof(unsigned short) * num_values);
+            values = copy;
+        }
+    } else if (!streaming) {
+        values = arena_alloc(arena, sizeof(unsigned short) * num_values);
+        convert_image_rows(image, values, image->rows, image->h, lookup, tileize);
+    }
+
+    /* make the colors fit if asked to, then swap in palette indices, or
+     * with 4bpp the indices into the bank of each tile */
+    int num_map_entries = (image->w / PNG2GBA_TILE_SIZE) * (image->h / PNG2GBA_TILE_SIZE);
+    unsigned short* banks = NULL;
+    int num_banks = 0;
+    int error = PNG2GBA_OK;
+    int i;
+    double indexing = now_seconds();
+    if (palette && !streaming) {
+        if (options->quantize) {
+            quantize_image(values, num_values, color_palette);
+        }
+        if (options->bpp4) {
+            /* the banks are made from the quantized colors themselves */
+            if (options->quantize) {
+                for (i = 0; i < num_values; i++) {
+                    values[i] = color_palette->colors[color_palette->index[values[i]]];
+                }
+            }
+            banks = arena_alloc(arena, sizeof(unsigned short) * num_map_entries);
+            num_banks = assign_banks(values, num_map_entries, color_palette, banks);
+            if (num_banks < 0) {
+                error = -num_banks;
+            }
+        } else if (!slots) {
+            error = index_colors(values, num_values, color_palette);
+        }
+    }
+    double indexed = now_seconds();
+    context->timings.palette += indexed - indexing;
+    if (error) {
+        return fail(context, error);
+    }
+
+    /* take out the repeated tiles, leaving a screen map to put them back,
+     * 4bpp tiles only have to match within their banks, since the bank of
+     * each tile goes into its screen entry */
+    unsigned short* map = NULL;
+    int num_tiles = 0;
+    if (options->dedup) {
+        map = arena_alloc(arena, sizeof(unsigned short) * num_map_entries);
+        num_tiles = dedup_tiles(values, num_map_entries, map);
+        num_values = num_tiles * TILE_VALUES;
+
+        /* any more and the tile numbers run into the flip and bank bits */
+        if (num_tiles > PNG2GBA_MAX_SCREEN_TILES) {
+            return fail(context, PNG2GBA_ERROR_TOO_MANY_TILES);
+        }
+        if (banks) {
+            for (i = 0; i < num_map_entries; i++) {
+                map[i] |= banks[i] << BANK_SHIFT;
+            }
+            banks = NULL;
+        }
+    }
+    context->num_tiles = num_tiles;
+
+    /* a large map can be split up for scrolling, in the same arena */
+    unsigned int* map_index = NULL;
+    int num_map_index = 0;
+    if (map && options->layout != PNG2GBA_LAYOUT_FLAT) {
+        int map_w = image->w / PNG2GBA_TILE_SIZE, map_h = image->h / PNG2GBA_TILE_SIZE;
+        int blocks = ((map_w + SCREENBLOCK_SIZE - 1) / SCREENBLOCK_SIZE)
+            * ((map_h + SCREENBLOCK_SIZE - 1) / SCREENBLOCK_SIZE);
+        unsigned short* laid_out = arena_alloc(arena, sizeof(unsigned short)
+                * (blocks * SCREENBLOCK_SIZE * SCREENBLOCK_SIZE));
+        map_index = arena_alloc(arena, sizeof(unsigned int) * (blocks + map_w + map_h));
+        num_map_entries = lay_out_map(laid_out, map_index, map, map_w, map_h,
+                options->layout, &num_map_index);
+        map = laid_out;
+    }
+
+    /* two 4bpp pixels go in each byte */
+    if (options->bpp4) {
+        pack_nibbles(values, num_values);
+        num_values /= 2;
+    }
+
+    /* compressed data and palettes are packed into raw bytes first */
+    struct png2gba_buffer packed = {NULL, 0, 0, NULL, 0};
+    struct png2gba_buffer packed_palette = {NULL, 0, 0, NULL, 0};
+    if (options->compress) {
+        struct png2gba_buffer raw = {NULL, 0, 0, NULL, 0};
+        write_binary_values(&raw, values, num_values, !palette);
+        error = png2gba_compress_data(&packed, (unsigned char*) raw.data, raw.size,
+                options->compress);
+        if (!error && palette && !shared_palette) {
+            raw.size = 0;
+            png2gba_write_binary_palette(&raw, color_palette);
+            error = png2gba_compress_data(&packed_palette, (unsigned char*) raw.data, raw.size,
+                    options->compress);
+        }
+        free(raw.data);
+        if (error) {
+            free(packed.data);
+            free(packed_palette.data);
+            return fail(context, error);
+        }
+    }
+    double converted = now_seconds();
+    context->timings.convert += converted - start - (indexed - indexing);
+
+    if(amount_of_files_to_be_processed > 1 && output_option){
+        index_2d_array_option = arena_printf(arena, "[%d]", amount_of_files_to_be_processed);
+        strcpy(beginning_paragraphs, "{{");
+        if(index == amount_of_files_to_be_processed - 1){
+            //Last file of the batch
+            strcpy(ending_paragraphs, "}};\n\n#endif");
+        }else{
+            strcpy(ending_paragraphs, "}");
+        }
+    }else{
+        strcpy(ending_paragraphs, "};\n\n#endif");
+    }
+
+    if(palette){
+        include_header = arena_printf(arena, "#include \"palette_%s\"\n\n", output_file_name);
+    }
+
+    /* only C headers have any text around the data */
+    if(options->format == PNG2GBA_FORMAT_C && (!output_option || index == 0)){
+        //First file of the batch
+        /* write preamble stuff */
+        buffer_printf(out, "/* %s\n * generated by png2gba program */\n\n", output_file_name);
+        //Add include guard for outdated and new compilers
+        buffer_printf(out, "#pragma once\n#ifndef %s_H\n#define %s_H\n\n", include_guard, include_guard);
+        buffer_puts(out, include_header);
+        buffer_printf(out, "#define %s_width %d\n", name, image->w);
+        buffer_printf(out, "#define %s_height %d\n\n", name, image->h);
+        if(output_option){
+            buffer_printf(out, "#define %s_entries %d\n\n", name, amount_of_files_to_be_processed);
+            palette_header4 = arena_printf(arena, "#define %s_palette_entries %d\n\n", name, amount_of_files_to_be_processed);
+        }else{
+            buffer_printf(out, "#define %s_entries %d\n\n", name, 1);
+            palette_header4 = arena_printf(arena, "#define %s_palette_entries %d\n\n", name, 1);
+        }
+        if (options->bpp4) {
+            buffer_printf(out, "#define %s_palette_banks %d\n\n", name, num_banks);
+        }
+        if (options->dedup) {
+            buffer_printf(out, "#define %s_tiles %d\n", name, num_tiles);
+            buffer_printf(out, "#define %s_map_width %d\n", name, image->w / PNG2GBA_TILE_SIZE);
+            buffer_printf(out, "#define %s_map_height %d\n\n", name, image->h / PNG2GBA_TILE_SIZE);
+            if (options->layout == PNG2GBA_LAYOUT_SCREENBLOCKS) {
+                buffer_printf(out, "#define %s_map_blocks_wide %d\n", name,
+                        (image->w / PNG2GBA_TILE_SIZE + SCREENBLOCK_SIZE - 1) / SCREENBLOCK_SIZE);
+                buffer_printf(out, "#define %s_map_blocks_high %d\n\n", name,
+                        (image->h / PNG2GBA_TILE_SIZE + SCREENBLOCK_SIZE - 1) / SCREENBLOCK_SIZE);
+            } else if (options->layout != PNG2GBA_LAYOUT_FLAT) {
+                buffer_printf(out, "#define %s_map_strips %d\n", name, num_map_index);
+                buffer_printf(out, "#define %s_map_strip_length %d\n\n", name,
+                        num_map_entries / num_map_index);
+            }
+        }
+
+        palette_header1 = arena_printf(arena, "/* palette_%s\n * generated by png2gba program */\n\n", output_file_name);
+        palette_header2 = arena_printf(arena, "//This palette file belongs to the file %s.h\n", name);
+        //Add include guard for outdated and new compilers
+        palette_header3 = arena_printf(arena, "#pragma once\n#ifndef PALETTE_%s_H\n#define PALETTE_%s_H\n\n#include \"%s\"\n\n", include_guard, include_guard, output_file_name);
+
+        if (options->compress) {
+            /* the BIOS wants compressed data on a word boundary */
+            buffer_printf(out, "%s = %s\n", array_declaration(arena, options, name, "data",
+                        "", packed.size, 1, 1), beginning_paragraphs);
+            palette_header5 = arena_printf(arena, "%s = %s\n", array_declaration(arena, options,
+                        name, "palette", "", packed_palette.size, 1, 1), beginning_paragraphs);
+        } else {
+            buffer_printf(out, "%s = %s\n", array_declaration(arena, options, name, "data",
+                        index_2d_array_option, num_values, palette ? 1 : 2, 0), beginning_paragraphs);
+
+            palette_header5 = arena_printf(arena, "%s = %s\n", array_declaration(arena, options,
+                        name, "palette", index_2d_array_option, PNG2GBA_PALETTE_SIZE, 2, 0),
+                    beginning_paragraphs);
+        }
+    }else{
+        palette_header5 = ",{\n";
+        if (options->format == PNG2GBA_FORMAT_C) {
+            buffer_puts(out, ",{\n");
+        }
+    }
+
+    /* write the data itself */
+    double stream_time = 0;
+    if (streaming) {
+        double stream_start = now_seconds();
+        error = stream_values(image, out, options->format, options->words, tileize,
+                palette ? color_palette : NULL, lookup, slots, &context->timings);
+        stream_time = now_seconds() - stream_start;
+    } else if (options->compress && options->format == PNG2GBA_FORMAT_C) {
+        write_bytes(out, &packed, options->words);
+    } else if (options->compress) {
+        png2gba_buffer_write(out, packed.data, packed.size);
+    } else if (options->format == PNG2GBA_FORMAT_C) {
+        int colors_this_line = 0;
+        write_c_values(out, values, num_values, !palette, options->words, &colors_this_line);
+    } else {
+        write_binary_values(out, values, num_values, !palette);
+    }
+    free(packed.data);
+    if (error) {
+        free(packed_palette.data);
+        return fail(context, error);
+    }
+
+    /* write postamble stuff, with the screen map going after the data */
+    if (map && options->format == PNG2GBA_FORMAT_C) {
+        int colors_this_line = 0;
+        buffer_printf(out, "\n};\n\n%s = {\n", array_declaration(arena, options, name,
+                    "map", "", num_map_entries, 2, 0));
+        write_c_values(out, map, num_map_entries, 1, options->words, &colors_this_line);
+    } else if (map) {
+        write_binary_values(png2gba_add_table(output, "map"), map, num_map_entries, 1);
+    }
+
+    /* followed by where each screenblock or strip of the map starts */
+    if (map_index && options->format == PNG2GBA_FORMAT_C) {
+        struct png2gba_buffer raw = {NULL, 0, 0, NULL, 0};
+        int words_this_line = 0;
+        write_binary_words(&raw, map_index, num_map_index);
+        buffer_printf(out, "\n};\n\n%s = {\n", array_declaration(arena, options, name,
+                    "map_index", "", num_map_index, 4, 0));
+        write_words(out, (unsigned char*) raw.data, raw.size, &words_this_line);
+        free(raw.data);
+    } else if (map_index) {
+        write_binary_words(png2gba_add_table(output, "map_index"), map_index, num_map_index);
+    }
+
+    /* without a map, the bank of each tile gets a table of its own */
+    if (banks && options->format == PNG2GBA_FORMAT_C) {
+        int colors_this_line = 0;
+        buffer_printf(out, "\n};\n\n%s = {\n", array_declaration(arena, options, name,
+                    "banks", "", num_map_entries, 1, 0));
+        write_c_values(out, banks, num_map_entries, 0, options->words, &colors_this_line);
+    } else if (banks) {
+        write_binary_values(png2gba_add_table(output, "banks"), banks, num_map_entries, 0);
+    }
+    if (options->format == PNG2GBA_FORMAT_C) {
+        buffer_printf(out, "\n%s", ending_paragraphs);
+    }
+    png2gba_buffer_flush(out);
+
+    /* write the palette if needed, a shared one is written after the batch */
+    if (palette && !shared_palette) {
+        if (options->format == PNG2GBA_FORMAT_C) {
+            buffer_puts(palette_out, palette_header1);
+            buffer_puts(palette_out, palette_header2);
+            buffer_puts(palette_out, palette_header3);
+            buffer_puts(palette_out, palette_header4);
+            buffer_puts(palette_out, palette_header5);
+            if (options->compress) {
+                write_bytes(palette_out, &packed_palette, options->words);
+            } else {
+                write_palette_colors(palette_out, color_palette, options->words);
+            }
+            buffer_printf(palette_out, "\n%s", ending_paragraphs);
+        } else if (options->compress) {
+            png2gba_buffer_write(palette_out, packed_palette.data, packed_palette.size);
+        } else {
+            png2gba_write_binary_palette(palette_out, color_palette);
+        }
+        png2gba_buffer_flush(palette_out);
+    }
+    free(packed_palette.data);
+    context->num_colors = palette ? color_palette->size : 0;
+    context->timings.emit += now_seconds() - converted - stream_time;
+    return PNG2GBA_OK;
+}
+
+/* the sprite shapes of the OAM in tiles, biggest first, along with their
+ * shape and size attribute bits */
+static const struct SpriteShape {
+    int w, h;
+    int shape, size;
+} sprite_shapes[] = {
+    {8, 8, 0, 3}, {8, 4, 1, 3}, {4, 8, 2, 3},
+    {4, 4, 0, 2}, {4, 2, 1, 2}, {2, 4, 2, 2},
+    {2, 2, 0, 1}, {4, 1, 1, 1}, {1, 4, 2, 1},
+    {2, 1, 1, 0}, {1, 2, 2, 0}, {1, 1, 0, 0}
+};
+
+/* the values in each entry of the object and frame tables of an atlas */
+#define OBJECT_VALUES 5
+#define FRAME_VALUES 4
+
+/* the OAM attribute bits for the shape and size of a sprite, and for 256
+ * color tiles */
+#define ATTR0_SHAPE_SHIFT 14
+#define ATTR1_SIZE_SHIFT 14
+#define ATTR0_8BPP 0x2000
+
+/* an atlas being packed, the tiles of its objects in the order 1D sprite
+ * mapping wants them and a hash of each object to find repeated ones */
+struct Atlas {
+    struct png2gba_buffer tiles;
+    unsigned short* objects;
+    uint64_t* hashes;
+    int num_objects;
+};
+
+/* copies one object of a sprite into the atlas, unless it is completely
+ * transparent, or the same as an earlier one whose tiles it then uses */
+static void add_object(struct Atlas* atlas, unsigned short* values, int width,
+        int x, int y, const struct SpriteShape* shape) {
+    int size = shape->w * shape->h * TILE_VALUES;
+    unsigned char* tiles = (unsigned char*) png2gba_buffer_reserve(&atlas->tiles, size);
+    int opaque = 0;
+    int tr, tc, r, i;
+
+    /* the tiles go row by row, and the rows of each tile in turn */
+    unsigned char* p = tiles;
+    for (tr = 0; tr < shape->h; tr++) {
+        for (tc = 0; tc < shape->w; tc++) {
+            for (r = 0; r < PNG2GBA_TILE_SIZE; r++) {
+                unsigned short* row = values + (y + tr * PNG2GBA_TILE_SIZE + r) * width
+                    + x + tc * PNG2GBA_TILE_SIZE;
+                for (i = 0; i < PNG2GBA_TILE_SIZE; i++) {
+                    opaque |= row[i];
+                    *p++ = row[i];
+                }
+            }
+        }
+    }
+    if (!opaque) {
+        return;
+    }
+
+    uint64_t hash = 0xcbf29ce484222325ULL ^ (shape - sprite_shapes);
+    for (i = 0; i < size; i++) {
+        hash = (hash ^ tiles[i]) * 0x100000001b3ULL;
+    }
+
+    /* an object holds its place in the frame and its OAM attributes, the
+     * tile number counts in 32 byte units, two for each 8bpp tile */
+    unsigned short* object = atlas->objects + atlas->num_objects * OBJECT_VALUES;
+    int tile = atlas->tiles.size / TILE_VALUES;
+    object[0] = x;
+    object[1] = y;
+    object[2] = (shape->shape << ATTR0_SHAPE_SHIFT) | ATTR0_8BPP;
+    object[3] = shape->size << ATTR1_SIZE_SHIFT;
+    for (i = 0; i < atlas->num_objects; i++) {
+        unsigned short* other = atlas->objects + i * OBJECT_VALUES;
+        if (atlas->hashes[i] == hash && other[2] == object[2] && other[3] == object[3]
+                && !memcmp(atlas->tiles.data + other[4] / 2 * TILE_VALUES, tiles, size)) {
+            tile = other[4] / 2;
+            break;
+        }
+    }
+    if (tile == (int) (atlas->tiles.size / TILE_VALUES)) {
+        atlas->tiles.size += size;
+    }
+    object[4] = tile * 2;
+    atlas->hashes[atlas->num_objects] = hash;
+    atlas->num_objects++;
+}
+
+/* covers a rectangle of a sprite with objects, taking the biggest shape
+ * which fits in the corner, then covering what is left to its right and
+ * below it the same way */
+static void cover_sprite(struct Atlas* atlas, unsigned short* values, int width,
+        int x, int y, int w, int h) {
+    const struct SpriteShape* shape = sprite_shapes;
+    if (!w || !h) {
+        return;
+    }
+    while (shape->w * PNG2GBA_TILE_SIZE > w || shape->h * PNG2GBA_TILE_SIZE > h) {
+        shape++;
+    }
+    add_object(atlas, values, width, x, y, shape);
+    cover_sprite(atlas, values, width, x + shape->w * PNG2GBA_TILE_SIZE, y,
+            w - shape->w * PNG2GBA_TILE_SIZE, shape->h * PNG2GBA_TILE_SIZE);
+    cover_sprite(atlas, values, width, x, y + shape->h * PNG2GBA_TILE_SIZE,
+            w, h - shape->h * PNG2GBA_TILE_SIZE);
+}
+
+/* packs a batch of sprites into one atlas, see png2gba.h */
+int png2gba_convert_atlas(struct png2gba_context* context, struct png2gba_image** images,
+        int count, struct png2gba_output* output, char* name) {
+    struct png2gba_options* options = &context->options;
+    double start = now_seconds();
+    int total_values = 0;
+    int f;
+
+    /* every sprite has to be made of whole tiles */
+    for (f = 0; f < count; f++) {
+        if (images[f]->w % PNG2GBA_TILE_SIZE || images[f]->h % PNG2GBA_TILE_SIZE
+                || !images[f]->rows) {
+            return fail(context, PNG2GBA_ERROR_TILE_SIZE);
+        }
+        total_values += images[f]->w * images[f]->h;
+    }
+
+    /* all of the sprites share one palette, so they are converted and
+     * quantized together, in the arena of the first one */
+    struct png2gba_arena* arena = &images[0]->arena;
+    unsigned short* values = arena_alloc(arena, sizeof(unsigned short) * total_values);
+    unsigned short* frame_values = values;
+    for (f = 0; f < count; f++) {
+        unsigned short lookup[PNG2GBA_PALETTE_SIZE];
+        if (images[f]->indexed) {
+            lookup_colors(images[f], lookup);
+        }
+        convert_image_rows(images[f], frame_values, images[f]->rows, images[f]->h, lookup, 0);
+        frame_values += images[f]->w * images[f]->h;
+    }
+    struct png2gba_palette* color_palette = arena_alloc(arena, sizeof(struct png2gba_palette));
+    png2gba_init_palette(color_palette, png2gba_hex24_to_15(options->colorkey));
+    double indexing = now_seconds();
+    if (options->quantize) {
+        quantize_image(values, total_values, color_palette);
+    }
+    int error = index_colors(values, total_values, color_palette);
+    double indexed = now_seconds();
+    context->timings.palette += indexed - indexing;
+    if (error) {
+        return fail(context, error);
+    }
+    context->num_colors = color_palette->size;
+
+    /* there are never more objects than tiles */
+    struct Atlas atlas;
+    memset(&atlas, 0, sizeof(struct Atlas));
+    atlas.objects = arena_alloc(arena, sizeof(unsigned short) * OBJECT_VALUES * (total_values / TILE_VALUES));
+    atlas.hashes = arena_alloc(arena, sizeof(uint64_t) * (total_values / TILE_VALUES));
+    unsigned short* frames = arena_alloc(arena, sizeof(unsigned short) * FRAME_VALUES * count);
+    frame_values = values;
+    for (f = 0; f < count; f++) {
+        int first = atlas.num_objects;
+        cover_sprite(&atlas, frame_values, images[f]->w, 0, 0, images[f]->w, images[f]->h);
+        frames[f * FRAME_VALUES] = first;
+        frames[f * FRAME_VALUES + 1] = atlas.num_objects - first;
+        frames[f * FRAME_VALUES + 2] = images[f]->w;
+        frames[f * FRAME_VALUES + 3] = images[f]->h;
+        frame_values += images[f]->w * images[f]->h;
+    }
+    int num_tiles = atlas.tiles.size / TILE_VALUES;
+    int num_object_values = atlas.num_objects * OBJECT_VALUES;
+    context->num_tiles = num_tiles;
+    double converted = now_seconds();
+    context->timings.convert += converted - start - (indexed - indexing);
+
+    char* output_name = png2gba_get_output_name(options->output_file_name, name,
+            png2gba_format_extensions[options->format]);
+    char* output_file_name = arena_printf(arena, "%s", output_name);
+    free(output_name);
+    while (strstr(name, "/")) {
+        name = strstr(name, "/") + 1;
+    }
+
+    if (options->format == PNG2GBA_FORMAT_C) {
+        struct png2gba_buffer* out = &output->data;
+        char* include_guard = get_include_guard(arena, output_file_name);
+        int colors_this_line = 0;
+        buffer_printf(out, "/* %s\n * generated by png2gba program */\n\n", output_file_name);
+        buffer_printf(out, "#pragma once\n#ifndef %s_H\n#define %s_H\n\n", include_guard, include_guard);
+        buffer_printf(out, "#include \"palette_%s\"\n\n", output_file_name);
+        buffer_printf(out, "#define %s_tiles %d\n", name, num_tiles);
+        buffer_printf(out, "#define %s_object_entries %d\n", name, atlas.num_objects);
+        buffer_printf(out, "#define %s_frame_entries %d\n\n", name, count);
+        buffer_printf(out, "%s = {\n", array_declaration(arena, options, name, "data", "",
+                    atlas.tiles.size, 1, 0));
+        write_bytes(out, &atlas.tiles, options->words);
+        buffer_puts(out, "\n};\n\n/* each object is its x and y in the frame and its OAM attributes 0-2,\n"
+                " * each frame is its first object, number of objects, width and height */\n");
+        buffer_printf(out, "%s = {\n", array_declaration(arena, options, name, "objects", "",
+                    num_object_values, 2, 0));
+        write_c_values(out, atlas.objects, num_object_values, 1, options->words, &colors_this_line);
+        colors_this_line = 0;
+        buffer_printf(out, "\n};\n\n%s = {\n", array_declaration(arena, options, name, "frames", "",
+                    count * FRAME_VALUES, 2, 0));
+        write_c_values(out, frames, count * FRAME_VALUES, 1, options->words, &colors_this_line);
+        buffer_puts(out, "\n};\n\n#endif");
+        write_palette_file(&output->palette, options, output_file_name, name, color_palette);
+    } else {
+        png2gba_buffer_write(&output->data, atlas.tiles.data, atlas.tiles.size);
+        png2gba_write_binary_palette(&output->palette, color_palette);
+        write_binary_values(png2gba_add_table(output, "objects"), atlas.objects,
+                num_object_values, 1);
+        write_binary_values(png2gba_add_table(output, "frames"), frames, count * FRAME_VALUES, 1);
+    }
+    png2gba_buffer_flush(&output->data);
+    png2gba_buffer_flush(&output->palette);
+
+    free(atlas.tiles.data);
+    context->timings.emit += now_seconds() - converted;
+    return PNG2GBA_OK;
+}
+
+/* the values for each frame of an animation, its first delta and how many
+ * deltas it has */
+#define DELTA_FRAME_VALUES 2
+
+int png2gba_convert_animation(struct png2gba_context* context, struct png2gba_image** images,
+        int count, struct png2gba_output* output, char* name) {
+    struct png2gba_options* options = &context->options;
+    double start = now_seconds();
+    int palette = options->palette;
+    int f, t;
+
+    /* every frame has to be made of the same whole tiles */
+    for (f = 0; f < count; f++) {
+        if (images[f]->w % PNG2GBA_TILE_SIZE || images[f]->h % PNG2GBA_TILE_SIZE
+                || !images[f]->rows) {
+            return fail(context, PNG2GBA_ERROR_TILE_SIZE);
+        }
+        if (images[f]->w != images[0]->w || images[f]->h != images[0]->h) {
+            return fail(context, PNG2GBA_ERROR_FRAME_SIZE);
+        }
+    }
+    int frame_size = images[0]->w * images[0]->h;
+    int num_tiles = frame_size / TILE_VALUES;
+
+    /* all of the frames share one palette, so they are converted and
+     * quantized together, in the arena of the first one */
+    struct png2gba_arena* arena = &images[0]->arena;
+    unsigned short* values = arena_alloc(arena, sizeof(unsigned short) * frame_size * count);
+    for (f = 0; f < count; f++) {
+        unsigned short lookup[PNG2GBA_PALETTE_SIZE];
+        if (images[f]->indexed) {
+            lookup_colors(images[f], lookup);
+        }
+        convert_image_rows(images[f], values + f * frame_size, images[f]->rows,
+                images[f]->h, lookup, 1);
+    }
+    struct png2gba_palette* color_palette = NULL;
+    double indexing = now_seconds();
+    context->num_colors = 0;
+    if (palette) {
+        color_palette = arena_alloc(arena, sizeof(struct png2gba_palette));
+        png2gba_init_palette(color_palette, png2gba_hex24_to_15(options->colorkey));
+        if (options->quantize) {
+            quantize_image(values, frame_size * count, color_palette);
+        }
+        int error = index_colors(values, frame_size * count, color_palette);
+        if (error) {
+            return fail(context, error);
+        }
+        context->num_colors = color_palette->size;
+    }
+    double indexed = now_seconds();
+    context->timings.palette += indexed - indexing;
+
+    /* every frame after the first keeps just the tiles which differ from
+     * the frame before it, along with where they go */
+    unsigned short* delta_tiles = arena_alloc(arena, sizeof(unsigned short) * frame_size * count);
+    unsigned short* delta_indices = arena_alloc(arena, sizeof(unsigned short) * num_tiles * count);
+    unsigned short* delta_frames = arena_alloc(arena, sizeof(unsigned short) * DELTA_FRAME_VALUES * count);
+    int num_deltas = 0;
+    delta_frames[0] = 0;
+    delta_frames[1] = 0;
+    for (f = 1; f < count; f++) {
+        delta_frames[f * DELTA_FRAME_VALUES] = num_deltas;
+        for (t = 0; t < num_tiles; t++) {
+            unsigned short* tile = values + f * frame_size + t * TILE_VALUES;
+            if (memcmp(tile, tile - frame_size, sizeof(unsigned short) * TILE_VALUES)) {
+                memcpy(delta_tiles + num_deltas * TILE_VALUES, tile,
+                        sizeof(unsigned short) * TILE_VALUES);
+                delta_indices[num_deltas++] = t;
+            }
+        }
+        delta_frames[f * DELTA_FRAME_VALUES + 1] = num_deltas - delta_frames[f * DELTA_FRAME_VALUES];
+    }
+    context->num_tiles = num_deltas;
+    double converted = now_seconds();
+    context->timings.convert += converted - start - (indexed - indexing);
+
+    char* output_name = png2gba_get_output_name(options->output_file_name, name,
+            png2gba_format_extensions[options->format]);
+    char* output_file_name = arena_printf(arena, "%s", output_name);
+    free(output_name);
+    while (strstr(name, "/")) {
+        name = strstr(name, "/") + 1;
+    }
+
+    if (options->format == PNG2GBA_FORMAT_C) {
+        struct png2gba_buffer* out = &output->data;
+        char* include_guard = get_include_guard(arena, output_file_name);
+        int colors_this_line = 0;
+        buffer_printf(out, "/* %s\n * generated by png2gba program */\n\n", output_file_name);
+        buffer_printf(out, "#pragma once\n#ifndef %s_H\n#define %s_H\n\n", include_guard, include_guard);
+        if (palette) {
+            buffer_printf(out, "#include \"palette_%s\"\n\n", output_file_name);
+        }
+        buffer_printf(out, "#define %s_width %d\n", name, images[0]->w);
+        buffer_printf(out, "#define %s_height %d\n", name, images[0]->h);
+        buffer_printf(out, "#define %s_frame_entries %d\n", name, count);
+        buffer_printf(out, "#define %s_delta_entries %d\n\n", name, num_deltas);
+        buffer_printf(out, "%s = {\n", array_declaration(arena, options, name, "data", "",
+                    frame_size, palette ? 1 : 2, 0));
+        write_c_values(out, values, frame_size, !palette, options->words, &colors_this_line);
+        buffer_puts(out, "\n};\n\n/* each frame after the first replaces the tiles numbered in delta_indices\n"
+                " * with the tiles of delta_tiles, each frame is its first delta and\n"
+                " * number of deltas */\n");
+        colors_this_line = 0;
+        buffer_printf(out, "%s = {\n", array_declaration(arena, options, name, "delta_tiles", "",
+                    num_deltas * TILE_VALUES, palette ? 1 : 2, 0));
+        write_c_values(out, delta_tiles, num_deltas * TILE_VALUES, !palette, options->words,
+                &colors_this_line);
+        colors_this_line = 0;
+        buffer_printf(out, "\n};\n\n%s = {\n", array_declaration(arena, options, name,
+                    "delta_indices", "", num_deltas, 2, 0));
+        write_c_values(out, delta_indices, num_deltas, 1, options->words, &colors_this_line);
+        colors_this_line = 0;
+        buffer_printf(out, "\n};\n\n%s = {\n", array_declaration(arena, options, name,
+                    "delta_frames", "", count * DELTA_FRAME_VALUES, 2, 0));
+        write_c_values(out, delta_frames, count * DELTA_FRAME_VALUES, 1, options->words,
+                &colors_this_line);
+        buffer_puts(out, "\n};\n\n#endif");
+        if (palette) {
+            write_palette_file(&output->palette, options, output_file_name, name, color_palette);
+        }
+    } else {
+        write_binary_values(&output->data, values, frame_size, !palette);
+        if (palette) {
+            png2gba_write_binary_palette(&output->palette, color_palette);
+        }
+        write_binary_values(png2gba_add_table(output, "delta_tiles"), delta_tiles,
+                num_deltas * TILE_VALUES, !palette);
+        write_binary_values(png2gba_add_table(output, "delta_indices"), delta_indices,
+                num_deltas, 1);
+        write_binary_values(png2gba_add_table(output, "delta_frames"), delta_frames,
+                count * DELTA_FRAME_VALUES, 1);
+    }
+    png2gba_buffer_flush(&output->data);
+    png2gba_buffer_flush(&output->palette);
+    context->timings.emit += now_seconds() - converted;
+    return PNG2GBA_OK;
+}
+
+int png2gba_convert_memory(struct png2gba_context* context, const void* data,
+        size_t size, char* name, struct png2gba_output* output) {
+    struct png2gba_image* image = png2gba_read_memory(context, data, size);
+    if (!image) {
+        return context->error;
+    }
+    int error = png2gba_convert(context, image, output, name, 0, 1, NULL);
+    png2gba_free_image(image);
+    return error;
+}
+
+void png2gba_default_options(struct png2gba_options* options) {
+    memset(options, 0, sizeof(struct png2gba_options));
+    options->format = PNG2GBA_FORMAT_C;
+    options->colorkey = "#ff00ff";
+}
+
+/* the tables every context uses are only filled in once */
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void init_tables() {
+    init_hex_tables();
+    png2gba_init_convert();
+}
+
+void png2gba_init_context(struct png2gba_context* context, struct png2gba_options* options) {
+    pthread_once(&tables_once, init_tables);
+    context->options = *options;
+    context->error = PNG2GBA_OK;
+    context->num_tiles = 0;
+    context->num_colors = 0;
+    memset(&context->timings, 0, sizeof(struct png2gba_timings));
+}
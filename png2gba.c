@@ -1,27 +1,25 @@
 /* png2gba.c
  * this program converts PNG images into C header files storing
- * arrays of data as required for programming the GBA */
+ * arrays of data as required for programming the GBA, the conversion itself
+ * is done by the png2gba library */
 
 #include <unistd.h>
+#include <stdint.h>
+#include <sys/stat.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <argp.h>
+#include <pthread.h>
+#include <time.h>
+#include <signal.h>
 
-#define PNG_DEBUG 3
-#include <png.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
 
-/* the GBA palette size is always 256 colors */
-#define PALETTE_SIZE 256
-
-/* the GBA always uses 8x8 tiles */
-#define TILE_SIZE 8
-
-/* the max 8-bit or 16-bit values on a row
- * this only affects aesthetics by keeping the files from exceeding a width
- * of 80 characters */
-#define MAX_ROW8 12
-#define MAX_ROW16 9
+#include "png2gba_private.h"
 
 /* the info for the command line parameters */
 const char* argp_program_version = "png2gba 1.0";
@@ -29,50 +27,261 @@ const char* argp_program_bug_address = "<ifinlay@umw.edu>";
 const char doc [] = "PNG to GBA image conversion utility";
 const char args_doc[] = "FILE";
 
+/* keys for the options which only have a long name */
+#define OPTION_CACHE 256
+#define OPTION_STREAM 257
+#define OPTION_WATCH 258
+#define OPTION_ATLAS 259
+#define OPTION_WORDS 260
+#define OPTION_ALIGN 261
+#define OPTION_SECTION 262
+#define OPTION_ANIM 263
+#define OPTION_LAYOUT 264
+#define OPTION_STATS 265
+#define OPTION_TRACE 266
+#define OPTION_TARGET 267
+
 /* the command line options for the compiler */
 const struct argp_option options[] = {
     {"output", 'o', "file", 0, "Specify output file", 0}, 
     {"colorkey", 'c', "color", 0, "Specify the transparent color (#rrggbb)", 0}, 
     {"palette", 'p', NULL, 0, "Use a palette in the produced image", 0},
     {"tileize", 't', NULL, 0, "Output the image as consecutive 8x8 tiles", 0},
+    {"shared-palette", 's', NULL, 0, "Use one palette for all files of a batch", 0},
+    {"quantize", 'q', NULL, 0, "Reduce images with too many colors for a palette", 0},
+    {"format", 'f', "format", 0, "Output format: c (default), bin or elf", 0},
+    {"jobs", 'j', "count", 0, "Convert this many files at once", 0},
+    {"compress", 'z', "type", 0, "Compress the data and palette for the BIOS: lz77, rle or huff", 0},
+    {"dedup", 'd', NULL, 0, "Tileize, leaving out repeated and flipped tiles and adding a screen map", 0},
+    {"4bpp", '4', NULL, 0, "Write 4bpp tiles, splitting the palette into banks of 16 colors", 0},
+    {"stream", OPTION_STREAM, NULL, 0, "Read and convert images 8 rows at a time to save memory", 0},
+    {"cache", OPTION_CACHE, "dir", 0, "Reuse earlier results for unchanged files from this directory", 0},
+    {"watch", OPTION_WATCH, NULL, 0, "Keep running, converting files again whenever they are saved", 0},
+    {"atlas", OPTION_ATLAS, NULL, 0, "Pack the batch into one sprite atlas of OAM shapes with a frame table", 0},
+    {"anim", OPTION_ANIM, NULL, 0, "Write the batch as an animation of a keyframe and the changed tiles of each frame", 0},
+    {"words", OPTION_WORDS, NULL, 0, "Write C arrays as aligned 32-bit words for DMA and CpuFastSet", 0},
+    {"align", OPTION_ALIGN, NULL, 0, "Align C arrays to 4 bytes", 0},
+    {"section", OPTION_SECTION, "place", 0, "Put the arrays in rom (default), ewram or iwram", 0},
+    {"layout", OPTION_LAYOUT, "layout", 0, "Split the map of -d into screenblocks, rows or columns with an index table", 0},
+    {"stats", OPTION_STATS, NULL, 0, "Print the time each file spent in each phase, and its pixels, colors and bytes", 0},
+    {"trace", OPTION_TRACE, "file", 0, "Write the phases of every file to a Chrome trace event file", 0},
+    {"target", OPTION_TARGET, "name:options", 0, "Convert each file X with these options into X_name, any number of targets share one decode", 0},
     {NULL, 0, NULL, 0, NULL, 0}
 };
 
-/* used by main to communicate with parse_opt */
+/* one of several conversions of every file, with options of its own, named
+ * after the file with _name on the end */
+struct Target {
+    char* name;
+    struct png2gba_options options;
+};
+
+/* used by main to communicate with parse_opt, the options of each target
+ * are parsed with parsing_target set */
 struct arguments {
-    int palette;
-    int tileize;
-    char* colorkey;
-    char* output_file_name;
+    struct png2gba_options options;
+    int shared_palette;
+    int jobs;
+    char* cache_dir;
+    int watch;
+    int atlas;
+    int anim;
+    int stats;
+    char* trace_file_name;
+    char** target_specs;
+    struct Target* targets;
+    int num_targets;
+    int parsing_target;
     char* input_file_name;
+    char** input_file_names;
+    int num_input_files;
 };
 
+/* whether an option is about the whole batch rather than the conversion
+ * of one file, which targets can't change */
+int batch_option(int key) {
+    switch (key) {
+        case 's':
+        case 'j':
+        case 'o':
+        case OPTION_STREAM:
+        case OPTION_CACHE:
+        case OPTION_WATCH:
+        case OPTION_ATLAS:
+        case OPTION_ANIM:
+        case OPTION_STATS:
+        case OPTION_TRACE:
+        case OPTION_TARGET:
+        case ARGP_KEY_ARG:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
 /* the function which parses command line options */
 error_t parse_opt (int key, char* arg, struct argp_state* state) {
 
     /* get the input argument from argp_parse */
     struct arguments *arguments = state->input;
 
+    if (arguments->parsing_target && batch_option(key)) {
+        argp_error(state, "A target can only have the options of a conversion!");
+    }
+
     /* switch on the command line option that was passed in */
     switch (key) {
         case 'p':
             /* set the palette option */
-            arguments->palette = 1;
+            arguments->options.palette = 1;
             break;
 
         case 't':
             /* set the tileize option */
-            arguments->tileize = 1;
+            arguments->options.tileize = 1;
+            break;
+
+        case 's':
+            /* set the shared palette option */
+            arguments->shared_palette = 1;
+            break;
+
+        case 'q':
+            /* set the quantize option */
+            arguments->options.quantize = 1;
+            break;
+
+        case 'f':
+            /* set the output format */
+            if (!strcmp(arg, "c")) {
+                arguments->options.format = PNG2GBA_FORMAT_C;
+            } else if (!strcmp(arg, "bin")) {
+                arguments->options.format = PNG2GBA_FORMAT_BIN;
+            } else if (!strcmp(arg, "elf")) {
+                arguments->options.format = PNG2GBA_FORMAT_ELF;
+            } else {
+                argp_error(state, "Unknown output format %s!", arg);
+            }
+            break;
+
+        case 'z':
+            /* set the compression */
+            if (!strcmp(arg, "lz77")) {
+                arguments->options.compress = PNG2GBA_COMPRESS_LZ77;
+            } else if (!strcmp(arg, "rle")) {
+                arguments->options.compress = PNG2GBA_COMPRESS_RLE;
+            } else if (!strcmp(arg, "huff")) {
+                arguments->options.compress = PNG2GBA_COMPRESS_HUFFMAN;
+            } else {
+                argp_error(state, "Unknown compression %s!", arg);
+            }
+            break;
+
+        case 'j':
+            /* set the number of worker threads */
+            arguments->jobs = atoi(arg);
+            if (arguments->jobs < 1) {
+                argp_error(state, "The number of jobs must be at least 1!");
+            }
             break;
 
         case 'o':
             /* the output file name is set */
-            arguments->output_file_name = arg;
+            arguments->options.output_file_name = arg;
+            break;
+
+        case 'd':
+            /* set the tile deduplication option */
+            arguments->options.dedup = 1;
+            break;
+
+        case '4':
+            /* set the 4bpp tile option, which always comes with a palette */
+            arguments->options.bpp4 = 1;
+            arguments->options.palette = 1;
+            break;
+
+        case OPTION_STREAM:
+            /* set the streaming option */
+            arguments->options.stream = 1;
+            break;
+
+        case OPTION_WATCH:
+            /* set the watch option */
+            arguments->watch = 1;
+            break;
+
+        case OPTION_ATLAS:
+            /* set the sprite atlas option */
+            arguments->atlas = 1;
+            break;
+
+        case OPTION_ANIM:
+            /* set the animation option */
+            arguments->anim = 1;
+            break;
+
+        case OPTION_WORDS:
+            /* set the 32-bit word option */
+            arguments->options.words = 1;
+            break;
+
+        case OPTION_ALIGN:
+            /* set the alignment option */
+            arguments->options.align = 1;
+            break;
+
+        case OPTION_SECTION:
+            /* set where the arrays go */
+            if (!strcmp(arg, "rom")) {
+                arguments->options.section = PNG2GBA_SECTION_ROM;
+            } else if (!strcmp(arg, "ewram")) {
+                arguments->options.section = PNG2GBA_SECTION_EWRAM;
+            } else if (!strcmp(arg, "iwram")) {
+                arguments->options.section = PNG2GBA_SECTION_IWRAM;
+            } else {
+                argp_error(state, "Unknown section %s!", arg);
+            }
+            break;
+
+        case OPTION_LAYOUT:
+            /* set how the screen map is laid out */
+            if (!strcmp(arg, "flat")) {
+                arguments->options.layout = PNG2GBA_LAYOUT_FLAT;
+            } else if (!strcmp(arg, "screenblocks")) {
+                arguments->options.layout = PNG2GBA_LAYOUT_SCREENBLOCKS;
+            } else if (!strcmp(arg, "rows")) {
+                arguments->options.layout = PNG2GBA_LAYOUT_ROWS;
+            } else if (!strcmp(arg, "columns")) {
+                arguments->options.layout = PNG2GBA_LAYOUT_COLUMNS;
+            } else {
+                argp_error(state, "Unknown layout %s!", arg);
+            }
+            break;
+
+        case OPTION_STATS:
+            /* set the statistics option */
+            arguments->stats = 1;
+            break;
+
+        case OPTION_TRACE:
+            /* the trace file is set */
+            arguments->trace_file_name = arg;
+            break;
+
+        case OPTION_TARGET:
+            /* another target, which is parsed once the options are known */
+            arguments->target_specs[arguments->num_targets++] = arg;
+            break;
+
+        case OPTION_CACHE:
+            /* the cache directory is set */
+            arguments->cache_dir = arg;
             break;
 
         case 'c':
             /* the colorkey is set */
-            arguments->colorkey = arg;
+            arguments->options.colorkey = arg;
             break;
 
             /* we got a file name */
@@ -87,11 +296,12 @@ error_t parse_opt (int key, char* arg, struct argp_state* state) {
 
             /* save it as an argument */
             arguments->input_file_name = arg;
+            arguments->input_file_names[arguments->num_input_files++] = arg;
             break;
 
             /* we hit the end of the arguments */
         case ARGP_KEY_END:
-            if (state->arg_num < 1) {
+            if (state->arg_num < 1 && !arguments->parsing_target) {
                 /* not enough arguments */
                 fprintf(stderr, "Error: Must pass an input file name!\n");
                 argp_usage(state);
@@ -108,496 +318,1446 @@ error_t parse_opt (int key, char* arg, struct argp_state* state) {
 /* the parameters to the argp library containing our program details */
 struct argp info = {options, parse_opt, args_doc, doc, NULL, NULL, NULL};
 
-/* a PNG image we load */
-struct Image {
-    int w, h, channels;
-    png_byte color_type;
-    png_byte bit_depth;
-    png_bytep* rows;
+/* parses each target, given as name:options, where the options are parsed
+ * like the command line of program_name on top of the options given for the
+ * whole batch */
+void parse_targets(struct arguments* args, char* program_name) {
+    args->targets = malloc(sizeof(struct Target) * args->num_targets);
+    for (int t = 0; t < args->num_targets; t++) {
+        char* spec = strdup(args->target_specs[t]);
+        char* colon = strchr(spec, ':');
+        if (!colon || colon == spec) {
+            fprintf(stderr, "Error: A target is given as name:options!\n");
+            exit(-1);
+        }
+        *colon = '\0';
+        for (int other = 0; other < t; other++) {
+            if (!strcmp(args->targets[other].name, spec)) {
+                fprintf(stderr, "Error: Every target needs a name of its own!\n");
+                exit(-1);
+            }
+        }
+
+        /* the options are split at spaces */
+        char** target_argv = malloc(sizeof(char*) * (strlen(colon + 1) + 2));
+        int target_argc = 0;
+        target_argv[target_argc++] = program_name;
+        for (char* word = strtok(colon + 1, " "); word; word = strtok(NULL, " ")) {
+            target_argv[target_argc++] = word;
+        }
+        struct arguments target_args = *args;
+        target_args.parsing_target = 1;
+        argp_parse(&info, target_argc, target_argv, 0, 0, &target_args);
+        free(target_argv);
+
+        if (target_args.options.layout && !target_args.options.dedup) {
+            fprintf(stderr, "Error: A map layout needs the screen map of -d!\n");
+            exit(-1);
+        }
+        args->targets[t].name = spec;
+        args->targets[t].options = target_args.options;
+    }
+}
+
+/* bump this whenever the output for the same input and options changes */
+#define CACHE_VERSION 3
+
+/* the room for the name of an extra table in a cache entry */
+#define CACHE_NAME_SIZE 32
+
+/* what --stats and --trace record about one file, in seconds on the clock
+ * of the library timings, map and cache are how long mapping the file and
+ * looking it up in the cache took, the conversion can happen on another
+ * thread than the decoding with a shared palette, and main writes it out */
+struct Stats {
+    struct png2gba_timings timings;
+    double start;
+    double map;
+    double cache;
+    double convert_start;
+    double write_start;
+    double write;
+    int thread;
+    int convert_thread;
+    int cached;
+    int colors;
+    size_t bytes;
 };
 
-/* load the png image from a file */
-struct Image* read_png(FILE* in) {
-    /* read the PNG signature */
-    unsigned char header[8];
-    fread(header, 1, 8, in);
-    if (png_sig_cmp(header, 0, 8)) {
-        fprintf(stderr, "Error: This does not seem to be a valid PNG file!\n");
-        exit(-1);
+/* one input file of a batch on its way through the worker threads, when
+ * watching the last output is saved for when other files change, and the
+ * names of tables loaded from the cache are kept here, opened is whether
+ * its files were opened before it was converted, and a job which failed
+ * keeps its error for main to report */
+struct Job {
+    char* input_file_name;
+    char* name;
+    struct png2gba_image* image;
+    struct png2gba_output output;
+    struct png2gba_output saved;
+    struct png2gba_output* target_outputs;
+    char cached_table_names[PNG2GBA_MAX_TABLES][CACHE_NAME_SIZE];
+    struct Stats stats;
+    int width, height;
+    int done;
+    int changed;
+    int opened;
+    int failed;
+    int error;
+};
+
+/* the batch of jobs shared between main and the worker threads, workers
+ * only take the jobs main has made ready, which stay at most window jobs
+ * ahead of what has been written out, traces count from origin, when
+ * png2gba started */
+struct Pool {
+    struct Job* jobs;
+    int num_jobs;
+    int next_job;
+    int jobs_ready;
+    int jobs_written;
+    int window;
+    struct arguments* args;
+    struct png2gba_palette* shared_palette;
+    int watching;
+    int num_workers;
+    double origin;
+    double run_start;
+    pthread_mutex_t lock;
+    pthread_cond_t job_done;
+    pthread_cond_t job_written;
+};
+
+/* continues a 64-bit FNV-1a hash over some bytes */
+uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
     }
+    return hash;
+}
 
-    /* setup structs for reading */
-    png_structp png_reader = png_create_read_struct(PNG_LIBPNG_VER_STRING,
-            NULL, NULL, NULL);
-    if (!png_reader) {
-        fprintf(stderr, "Error: Could not read PNG file!\n");
-        exit(-1);
+/* continues a hash over a string, including its terminator */
+uint64_t hash_string(uint64_t hash, const char* text) {
+    return hash_bytes(hash, text ? text : "", text ? strlen(text) + 1 : 1);
+}
+
+/* works out the cache key of a job, which covers everything its output
+ * depends on: the PNG bytes, the options, the names and the job's place in
+ * the batch */
+uint64_t cache_key(struct Pool* pool, int i, struct png2gba_memory* input) {
+    struct arguments* args = pool->args;
+    int settings[] = {CACHE_VERSION, args->options.palette, args->options.tileize,
+        args->options.quantize, args->options.format, args->options.dedup,
+        args->options.compress, args->options.bpp4, args->options.words,
+        args->options.align, args->options.section, args->options.layout, i, pool->num_jobs};
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    hash = hash_bytes(hash, settings, sizeof(settings));
+    hash = hash_string(hash, args->options.colorkey);
+    hash = hash_string(hash, args->options.output_file_name);
+    hash = hash_string(hash, pool->jobs[i].name);
+    return hash_bytes(hash, input->data, input->size);
+}
+
+/* builds the file name of a cache entry */
+char* cache_file_name(const char* cache_dir, uint64_t key) {
+    char* file_name = malloc(strlen(cache_dir) + 32);
+    sprintf(file_name, "%s/%016llx.cache", cache_dir, (unsigned long long) key);
+    return file_name;
+}
+
+/* reads one buffer of a cache entry, which is its size then its bytes */
+int read_cached_buffer(FILE* in, struct png2gba_buffer* buffer) {
+    uint64_t size;
+    if (fread(&size, sizeof(uint64_t), 1, in) != 1) {
+        return 0;
     }
-    png_infop png_info = png_create_info_struct(png_reader);
-    if (!png_info) {
-        fprintf(stderr, "Error: Could not read PNG file!\n");
-        exit(-1);
+    if (fread(png2gba_buffer_reserve(buffer, size), 1, size, in) != size) {
+        return 0;
     }
-    if (setjmp(png_jmpbuf(png_reader))) {
-        fprintf(stderr, "Error: Could not read PNG file!\n");
-        exit(-1);
+    buffer->size += size;
+    return 1;
+}
+
+/* writes one buffer of a cache entry */
+void write_cached_buffer(FILE* out, struct png2gba_buffer* buffer) {
+    uint64_t size = buffer->size;
+    fwrite(&size, sizeof(uint64_t), 1, out);
+    fwrite(buffer->data, 1, buffer->size, out);
+}
+
+/* fills in a job from the cache, returns whether it was there, an entry is
+ * the width, height, number of tables and number of palette colors followed
+ * by the data, palette and each table with its name, the names are kept in
+ * the job since the output only points at them */
+int load_cache(struct Pool* pool, struct Job* job, uint64_t key) {
+    char* file_name = cache_file_name(pool->args->cache_dir, key);
+    FILE* in = fopen(file_name, "rb");
+    free(file_name);
+    if (!in) {
+        return 0;
     }
 
-    /* allocate an image */
-    struct Image* image = malloc(sizeof(struct Image));
+    uint64_t sizes[4];
+    int found = fread(sizes, sizeof(uint64_t), 4, in) == 4 && sizes[2] <= PNG2GBA_MAX_TABLES
+        && read_cached_buffer(in, &job->output.data)
+        && read_cached_buffer(in, &job->output.palette);
+    unsigned int t;
+    for (t = 0; found && t < sizes[2]; t++) {
+        char* table_name = job->cached_table_names[t];
+        found = fread(table_name, 1, CACHE_NAME_SIZE, in) == CACHE_NAME_SIZE
+            && table_name[CACHE_NAME_SIZE - 1] == '\0'
+            && read_cached_buffer(in, png2gba_add_table(&job->output, table_name));
+    }
+    fclose(in);
 
-    /* read in the header information */
-    png_init_io(png_reader, in);
-    png_set_sig_bytes(png_reader, 8);
-    png_read_info(png_reader, png_info);
-    image->w = png_get_image_width(png_reader, png_info);
-    image->h = png_get_image_height(png_reader, png_info);
-    image->color_type = png_get_color_type(png_reader, png_info);
-    image->bit_depth = png_get_bit_depth(png_reader, png_info);
-    png_set_interlace_handling(png_reader);
-    png_read_update_info(png_reader, png_info);
+    if (!found) {
+        png2gba_free_output(&job->output);
+        return 0;
+    }
+    job->width = sizes[0];
+    job->height = sizes[1];
+    job->stats.colors = sizes[3];
+    return 1;
+}
 
-    /* read the actual file */
-    if (setjmp(png_jmpbuf(png_reader))) {
-        fprintf(stderr, "Error: Could not read PNG file!\n");
-        exit(-1);
+/* the temporary file something is written to before it replaces the real
+ * file, which goes beside it so that it can be renamed over it */
+char* get_temp_name(const char* file_name) {
+    char* temp_name = malloc(strlen(file_name) + 32);
+    sprintf(temp_name, "%s.%d.tmp", file_name, (int) getpid());
+    return temp_name;
+}
+
+/* saves the output of a job to the cache, going through a temporary file so
+ * that other runs never see a partial entry */
+void store_cache(struct Pool* pool, struct Job* job, uint64_t key) {
+    /* a table whose name doesn't fit is never cached */
+    int t;
+    for (t = 0; t < job->output.num_tables; t++) {
+        if (strlen(job->output.table_names[t]) >= CACHE_NAME_SIZE) {
+            return;
+        }
+    }
+
+    char* file_name = cache_file_name(pool->args->cache_dir, key);
+    char* temp_name = get_temp_name(file_name);
+    FILE* out = fopen(temp_name, "wb");
+    if (out) {
+        uint64_t sizes[4] = {job->width, job->height, job->output.num_tables,
+            job->stats.colors};
+        fwrite(sizes, sizeof(uint64_t), 4, out);
+        write_cached_buffer(out, &job->output.data);
+        write_cached_buffer(out, &job->output.palette);
+        for (t = 0; t < job->output.num_tables; t++) {
+            char table_name[CACHE_NAME_SIZE] = {0};
+            strcpy(table_name, job->output.table_names[t]);
+            fwrite(table_name, 1, CACHE_NAME_SIZE, out);
+            write_cached_buffer(out, &job->output.tables[t]);
+        }
+        if (fclose(out) == 0) {
+            rename(temp_name, file_name);
+        } else {
+            remove(temp_name);
+        }
     }
-    image->rows = (png_bytep*) malloc(sizeof(png_bytep) * image->h);
-    int r;
-    for (r = 0; r < image->h; r++) {
-        image->rows[r] = malloc(png_get_rowbytes(png_reader,png_info));
+    free(temp_name);
+    free(file_name);
+}
+
+/* appends the contents of one buffer to another */
+void buffer_append(struct png2gba_buffer* buffer, struct png2gba_buffer* other) {
+    png2gba_buffer_write(buffer, other->data, other->size);
+}
+
+/* copies everything in one output to another, which is emptied first */
+void copy_output(struct png2gba_output* output, struct png2gba_output* other) {
+    int t;
+    png2gba_free_output(output);
+    buffer_append(&output->data, &other->data);
+    buffer_append(&output->palette, &other->palette);
+    for (t = 0; t < other->num_tables; t++) {
+        buffer_append(png2gba_add_table(output, other->table_names[t]), &other->tables[t]);
     }
-    png_read_image(png_reader, image->rows);
+}
+
+/* the error of a job whose input file could not be opened, the others are
+ * the error codes of the library */
+#define ERROR_INPUT -1
 
-    /* check format */
-    if (png_get_color_type(png_reader, png_info) == PNG_COLOR_TYPE_RGB) {
-        image->channels = 3;
-    } else if (png_get_color_type(png_reader,png_info)==PNG_COLOR_TYPE_RGBA) {
-        image->channels = 4;
+/* marks a job as failed, main reports it once it gets to the job */
+void job_failed(struct Job* job, int error) {
+    job->failed = 1;
+    job->error = error;
+}
+
+/* reports a job which failed, and gives up on the batch unless we are
+ * watching, then the file keeps its last good output until it is saved
+ * again */
+void report_failure(struct Pool* pool, struct Job* job) {
+    if (job->error == ERROR_INPUT) {
+        fprintf(stderr, "Error: Can not open %s for reading!\n", job->input_file_name);
     } else {
-        fprintf(stderr, "Error: PNG file is not in the RGB or RGBA format!\n");
+        fprintf(stderr, "Error: %s\n", png2gba_error_message(job->error));
+    }
+    if (!pool->watching) {
         exit(-1);
     }
+}
 
-    /* close the input file and return */
-    fclose(in);
-    return image;
+/* the current time in seconds, on the clock of the library timings */
+double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* opens an input file, where "-" is standard input */
+FILE* open_input(const char* file_name) {
+    if (!strcmp(file_name, "-")) {
+        return stdin;
+    }
+    return fopen(file_name, "rb");
+}
+
+/* converts the decoded image of a job into its buffers and frees it */
+void convert_image(struct Pool* pool, int i, struct png2gba_palette* shared_palette) {
+    struct Job* job = &pool->jobs[i];
+    struct png2gba_context context;
+    png2gba_init_context(&context, &pool->args->options);
+    job->stats.convert_start = now_seconds();
+    job->stats.convert_thread = shared_palette ? 0 : job->stats.thread;
+    if (png2gba_convert(&context, job->image, &job->output, job->name,
+                i, pool->num_jobs, shared_palette)) {
+        job_failed(job, context.error);
+    }
+    job->stats.timings.decode += context.timings.decode;
+    job->stats.timings.convert = context.timings.convert;
+    job->stats.timings.palette = context.timings.palette;
+    job->stats.timings.emit = context.timings.emit;
+    job->stats.colors = context.num_colors;
+    png2gba_free_image(job->image);
+    job->image = NULL;
+}
+
+/* the name of a target of a job, which the caller frees */
+char* get_target_name(struct Job* job, struct Target* target) {
+    char* target_name = malloc(strlen(job->name) + strlen(target->name) + 2);
+    sprintf(target_name, "%s_%s", job->name, target->name);
+    return target_name;
+}
+
+/* converts the decoded image of a job once for every target into outputs
+ * which stay in memory, the targets share the colors of the image, then
+ * frees it */
+void convert_targets(struct Pool* pool, int i) {
+    struct Job* job = &pool->jobs[i];
+    struct arguments* args = pool->args;
+    job->target_outputs = calloc(args->num_targets, sizeof(struct png2gba_output));
+    job->image->share_colors = args->num_targets > 1;
+    job->stats.convert_start = now_seconds();
+    job->stats.convert_thread = job->stats.thread;
+
+    for (int t = 0; t < args->num_targets; t++) {
+        struct png2gba_context context;
+        png2gba_init_context(&context, &args->targets[t].options);
+        char* target_name = get_target_name(job, &args->targets[t]);
+        int error = png2gba_convert(&context, job->image, &job->target_outputs[t],
+                target_name, 0, 1, NULL);
+        free(target_name);
+        if (error) {
+            job_failed(job, context.error);
+            break;
+        }
+        job->stats.timings.convert += context.timings.convert;
+        job->stats.timings.palette += context.timings.palette;
+        job->stats.timings.emit += context.timings.emit;
+        if (context.num_colors > job->stats.colors) {
+            job->stats.colors = context.num_colors;
+        }
+    }
+    png2gba_free_image(job->image);
+    job->image = NULL;
+}
+
+/* decodes and converts one file into the buffers of its job, with a shared
+ * palette the conversion has to happen in order so it is left to main */
+void convert_job(struct Pool* pool, int i) {
+    struct Job* job = &pool->jobs[i];
+
+    /* when watching, files which have not changed keep their last output */
+    if (pool->watching && !job->changed) {
+        copy_output(&job->output, &job->saved);
+        return;
+    }
+
+    job->stats.start = now_seconds();
+    FILE* input = open_input(job->input_file_name);
+    if (!input) {
+        job_failed(job, ERROR_INPUT);
+        return;
+    }
+
+    /* the whole file is mapped, so the cache key and the decoder both read
+     * it straight from memory */
+    struct png2gba_memory memory;
+    int error = png2gba_map_file(input, &memory);
+    if (error) {
+        job_failed(job, error);
+        return;
+    }
+    job->stats.map = now_seconds() - job->stats.start;
+
+    /* a shared palette depends on every other file, so it is never cached */
+    int caching = pool->args->cache_dir && !pool->shared_palette;
+    uint64_t key = 0;
+    if (caching) {
+        double looking = now_seconds();
+        key = cache_key(pool, i, &memory);
+        job->stats.cached = load_cache(pool, job, key);
+        job->stats.cache = now_seconds() - looking;
+        if (job->stats.cached) {
+            png2gba_unmap(&memory);
+            return;
+        }
+    }
+
+    struct png2gba_context context;
+    png2gba_init_context(&context, &pool->args->options);
+    job->image = png2gba_read_mapped(&context, &memory);
+    if (!job->image) {
+        job_failed(job, context.error);
+        return;
+    }
+    job->width = job->image->w;
+    job->height = job->image->h;
+    job->stats.timings = context.timings;
+
+    if (pool->args->num_targets) {
+        convert_targets(pool, i);
+    } else if (!pool->shared_palette) {
+        /* a cached result is kept whole, its files are only opened by main
+         * once it is done */
+        convert_image(pool, i, NULL);
+        if (caching && !job->failed) {
+            store_cache(pool, job, key);
+        }
+    }
+}
+
+/* a worker thread, which takes jobs in order until there are none left */
+void* worker(void* data) {
+    struct Pool* pool = data;
+    pthread_mutex_lock(&pool->lock);
+    int thread = ++pool->num_workers;
+    while (pool->next_job < pool->num_jobs) {
+        /* wait for main to make the next job ready */
+        if (pool->next_job >= pool->jobs_ready) {
+            pthread_cond_wait(&pool->job_written, &pool->lock);
+            continue;
+        }
+        int i = pool->next_job++;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool->jobs[i].stats.thread = thread;
+        convert_job(pool, i);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->jobs[i].done = 1;
+        pthread_cond_broadcast(&pool->job_done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/* builds the name of a file which goes beside an output file, like the
+ * palette_ file of a header */
+char* get_side_file_name(const char* prefix, char* output_name) {
+    char* side_name = malloc(strlen(prefix) + strlen(output_name) + 2);
+    sprintf(side_name, "%s_%s", prefix, output_name);
+    return side_name;
+}
+
+/* the temporary files of outputs which are not finished yet, removed if
+ * png2gba exits or is stopped before it gets to them, the list only changes
+ * on the main thread with the stopping signals blocked, so the handler
+ * never sees it half changed */
+struct TempFile {
+    char* name;
+    struct TempFile* next;
+};
+struct TempFile* temp_files = NULL;
+pthread_mutex_t temp_files_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* blocks or unblocks the signals which stop png2gba */
+void block_stop_signals(int how) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(how, &signals, NULL);
+}
+
+/* adds a temporary file to the list, or takes it off once it is finished */
+void track_temp_file(char* temp_name, int open) {
+    block_stop_signals(SIG_BLOCK);
+    pthread_mutex_lock(&temp_files_lock);
+    struct TempFile** link = &temp_files;
+    while (*link && strcmp((*link)->name, temp_name)) {
+        link = &(*link)->next;
+    }
+    if (open && !*link) {
+        struct TempFile* temp = malloc(sizeof(struct TempFile));
+        temp->name = strdup(temp_name);
+        temp->next = temp_files;
+        temp_files = temp;
+    } else if (!open && *link) {
+        struct TempFile* temp = *link;
+        *link = temp->next;
+        free(temp->name);
+        free(temp);
+    }
+    pthread_mutex_unlock(&temp_files_lock);
+    block_stop_signals(SIG_UNBLOCK);
+}
+
+/* removes the temporary files left when png2gba exits on an error */
+void remove_temp_files() {
+    pthread_mutex_lock(&temp_files_lock);
+    for (struct TempFile* temp = temp_files; temp; temp = temp->next) {
+        unlink(temp->name);
+    }
+    pthread_mutex_unlock(&temp_files_lock);
 }
 
-/* inserts a color into a palette and returns the index, or return
- * the existing index if the color is already there */
-unsigned char insert_palette(unsigned short color,
-        unsigned short* color_palette, unsigned char* palette_size) {
+/* removes the temporary files when png2gba is stopped, and then stops the
+ * way it would have without the handler */
+void stop_on_signal(int signal_number) {
+    for (struct TempFile* temp = temp_files; temp; temp = temp->next) {
+        unlink(temp->name);
+    }
+    signal(signal_number, SIG_DFL);
+    raise(signal_number);
+}
 
-    /* loop through the palette */
-    unsigned char i;
-    for (i = 0; i < *palette_size; i++) {
-        /* if this is it, return it */
-        if (color_palette[i] == color) {
-            return i;
+/* opens the temporary file of an output, appending carries on with the
+ * same temporary file, so a batch can go into one file */
+FILE* open_output(const char* file_name, const char* mode) {
+    char* temp_name = get_temp_name(file_name);
+    FILE* file = fopen(temp_name, mode);
+    if (!file) {
+        fprintf(stderr, "Error: Can not open %s for writing!\n", file_name);
+        exit(-1);
+    }
+    track_temp_file(temp_name, 1);
+    free(temp_name);
+    return file;
+}
+
+/* whether two files hold the same bytes */
+int same_contents(const char* file_name, const char* other_name) {
+    FILE* file = fopen(file_name, "rb");
+    FILE* other = fopen(other_name, "rb");
+    int same = file && other;
+    while (same) {
+        char chunk[FLUSH_SIZE], other_chunk[FLUSH_SIZE];
+        size_t size = fread(chunk, 1, sizeof(chunk), file);
+        same = fread(other_chunk, 1, sizeof(other_chunk), other) == size
+            && !memcmp(chunk, other_chunk, size);
+        if (size < sizeof(chunk)) {
+            break;
         }
     }
+    if (file) {
+        fclose(file);
+    }
+    if (other) {
+        fclose(other);
+    }
+    return same;
+}
 
-    /* if the palette is full, we're in trouble */
-    if (*palette_size == (PALETTE_SIZE - 1)) {
-        fprintf(stderr, "Error: Too many colors in image for a palette!\n");
+/* puts a complete output in place of the real file, unless they are the
+ * same, then the real file keeps its modification time so that nothing
+ * which depends on it is rebuilt, an interrupted run never leaves a file
+ * half written */
+void finish_output(const char* file_name) {
+    char* temp_name = get_temp_name(file_name);
+    if (same_contents(temp_name, file_name)) {
+        unlink(temp_name);
+    } else if (rename(temp_name, file_name)) {
+        fprintf(stderr, "Error: Can not write %s!\n", file_name);
         exit(-1);
     }
+    track_temp_file(temp_name, 0);
+    free(temp_name);
+}
+
+/* opens the data and palette files of a job, an ELF object is written in
+ * one go instead once all of its data is known */
+void open_job_files(struct Job* job, struct arguments* args,
+        struct png2gba_palette* shared_palette, char* output_name, char* mode) {
+    if (args->options.format == PNG2GBA_FORMAT_ELF) {
+        return;
+    }
+    if (args->options.palette && !shared_palette) {
+        char* palette_output_name = get_side_file_name("palette", output_name);
+        job->output.palette.file = open_output(palette_output_name, mode);
+        free(palette_output_name);
+    }
+    job->output.data.file = open_output(output_name, mode);
+}
+
+/* puts the files of a job in place once they are complete */
+void finish_job_files(struct Job* job, struct arguments* args,
+        struct png2gba_palette* shared_palette, char* output_name) {
+    finish_output(output_name);
+    if (args->options.palette && !shared_palette) {
+        char* palette_output_name = get_side_file_name("palette", output_name);
+        finish_output(palette_output_name);
+        free(palette_output_name);
+    }
+    for (int t = 0; t < job->output.num_tables; t++) {
+        char* table_output_name = get_side_file_name(job->output.table_names[t], output_name);
+        finish_output(table_output_name);
+        free(table_output_name);
+    }
+}
 
-    /* it was not found, so add it */
-    color_palette[*palette_size] = color;
+/* how many bytes of an output have been written out, or are waiting to be */
+size_t output_bytes(struct png2gba_output* output) {
+    size_t bytes = output->data.written + output->data.size
+        + output->palette.written + output->palette.size;
+    for (int t = 0; t < output->num_tables; t++) {
+        bytes += output->tables[t].written + output->tables[t].size;
+    }
+    return bytes;
+}
 
-    /* increment palette size */
-    (*palette_size)++;
+/* whether a job was converted in this run, and so has stats to report */
+int job_reported(struct Job* job) {
+    return job->changed && !job->failed;
+}
 
-    /* return the index */
-    return (*palette_size) - 1;
+/* prints the stats of every file converted in this run in milliseconds,
+ * along with their totals */
+void print_stats(struct Pool* pool) {
+    struct Stats total;
+    long total_pixels = 0;
+    int num_files = 0;
+    memset(&total, 0, sizeof(struct Stats));
+    fprintf(stderr, "%10s %6s %9s %8s %8s %8s %8s %8s %8s  %s\n", "pixels", "colors",
+            "bytes", "read", "decode", "convert", "palette", "emit", "write", "file");
+    for (int i = 0; i < pool->num_jobs; i++) {
+        struct Job* job = &pool->jobs[i];
+        struct Stats* stats = &job->stats;
+        if (!job_reported(job)) {
+            continue;
+        }
+        long pixels = (long) job->width * job->height;
+        fprintf(stderr, "%10ld %6d %9zu %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f  %s%s\n",
+                pixels, stats->colors, stats->bytes, (stats->map + stats->cache) * 1000,
+                stats->timings.decode * 1000, stats->timings.convert * 1000,
+                stats->timings.palette * 1000, stats->timings.emit * 1000,
+                stats->write * 1000, job->input_file_name, stats->cached ? " (cached)" : "");
+        total_pixels += pixels;
+        total.bytes += stats->bytes;
+        total.map += stats->map + stats->cache;
+        total.timings.decode += stats->timings.decode;
+        total.timings.convert += stats->timings.convert;
+        total.timings.palette += stats->timings.palette;
+        total.timings.emit += stats->timings.emit;
+        total.write += stats->write;
+        num_files++;
+    }
+    fprintf(stderr, "%10ld %6s %9zu %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f  total\n",
+            total_pixels, "", total.bytes, total.map * 1000, total.timings.decode * 1000,
+            total.timings.convert * 1000, total.timings.palette * 1000,
+            total.timings.emit * 1000, total.write * 1000);
+
+    double seconds = now_seconds() - pool->run_start;
+    fprintf(stderr, "%d files in %.3f ms on %d threads, %.2f megapixels per second\n",
+            num_files, seconds * 1000, pool->args->jobs, total_pixels / seconds / 1e6);
 }
 
-/* returns the next pixel from the image, based on whether we
- * are tile-izing or not, returns NULL when we have done them all */
-png_byte* next_byte(struct Image* image, int tileize) {
-    /* keeps track of where we are in the "global" image */
-    static int r = 0;
-    static int c = 0;
+/* writes a string as a JSON string */
+void write_json_string(FILE* out, const char* text) {
+    fputc('"', out);
+    for (; *text; text++) {
+        if (*text == '"' || *text == '\\') {
+            fprintf(out, "\\%c", *text);
+        } else if ((unsigned char) *text < 0x20) {
+            fprintf(out, "\\u%04x", *text);
+        } else {
+            fputc(*text, out);
+        }
+    }
+    fputc('"', out);
+}
 
-    /* keeps track of where we are relative to one tile (0-7) */
-    static int tr = 0;
-    static int tc = 0;
+/* writes one complete event of a trace for the file of a job, returning
+ * when it ends, times are in seconds and traces count in microseconds */
+double write_trace_event(FILE* out, struct Pool* pool, struct Job* job,
+        const char* name, int thread, double start, double duration) {
+    fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"png2gba\", \"ph\": \"X\", \"pid\": 1, "
+            "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"file\": ", name, thread,
+            (start - pool->origin) * 1e6, duration * 1e6);
+    write_json_string(out, job->input_file_name);
+    fputs("}}", out);
+    return start + duration;
+}
 
-    /* if we have gone through it all */
-    if (r == image->h) {
-        //Reset all parameters to reuse them
-        r = 0;
-        c = 0;
-        tr = 0;
-        tc = 0;
-        return NULL;
+/* writes the phases of every file converted in this run as Chrome trace
+ * events, with a thread for main and each worker, the phases of a
+ * conversion are shown one after another with their total times, and the
+ * whole file with its pixels, colors and bytes above them */
+void write_trace(struct Pool* pool) {
+    FILE* out = open_output(pool->args->trace_file_name, "wb");
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n"
+            "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, "
+            "\"args\": {\"name\": \"main\"}}");
+    for (int t = 1; t <= pool->num_workers; t++) {
+        fprintf(out, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                "\"args\": {\"name\": \"worker %d\"}}", t, t);
     }
 
-    /* get the pixel next */
-    png_byte* row = image->rows[r];
-    png_byte* ptr = &(row[c * image->channels]);
+    for (int i = 0; i < pool->num_jobs; i++) {
+        struct Job* job = &pool->jobs[i];
+        struct Stats* stats = &job->stats;
+        if (!job_reported(job)) {
+            continue;
+        }
 
-    /* increment things based on if we are tileizing or not */
-    if (!tileize) {
-        /* just go sequentially, wrapping to the next row at the end of a column */
-        c++;
-        if (c >= image->w) {
-            r++;
-            c = 0;
+        /* everything on the thread which picked up the file */
+        double end = write_trace_event(out, pool, job, "map", stats->thread,
+                stats->start, stats->map);
+        if (stats->cache) {
+            end = write_trace_event(out, pool, job, "cache", stats->thread, end, stats->cache);
+        }
+        if (!stats->cached) {
+            end = write_trace_event(out, pool, job, "decode", stats->thread,
+                    stats->timings.start, stats->timings.decode);
         }
-    } else {
-        /* increment the column */
-        c++;
-        tc++;
-
-        /* if we hit the end of a tile row */
-        if (tc >= 8) {
-            /* go to the next one */
-            r++;
-            tr++;
-            c -= 8;
-            tc = 0;
-
-            /* if we hit the end of the tile altogether */
-            if (tr >= 8) {
-                r -= 8;
-                tr = 0;
-                c += 8;
-            }
 
-            /* if we are now at the end of the actual row, go to next one */
-            if (c >= image->w) {
-                tc = 0;
-                tr = 0;
-                c = 0;
-                r += 8;
+        /* which may go on with the conversion, unless main does that */
+        if (stats->convert_start) {
+            double at = stats->convert_start;
+            if (stats->convert_thread == stats->thread && at < end) {
+                at = end;
             }
+            at = write_trace_event(out, pool, job, "convert", stats->convert_thread,
+                    at, stats->timings.convert);
+            at = write_trace_event(out, pool, job, "palette", stats->convert_thread,
+                    at, stats->timings.palette);
+            at = write_trace_event(out, pool, job, "emit", stats->convert_thread,
+                    at, stats->timings.emit);
+            if (stats->convert_thread == stats->thread && !pool->args->atlas
+                    && !pool->args->anim) {
+                end = at;
+            }
+        }
+        fprintf(out, ",\n{\"name\": ");
+        write_json_string(out, job->name);
+        fprintf(out, ", \"cat\": \"file\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"pixels\": %ld, \"colors\": %d, "
+                "\"bytes\": %zu, \"cached\": %d}}", stats->thread,
+                (stats->start - pool->origin) * 1e6, (end - stats->start) * 1e6,
+                (long) job->width * job->height, stats->colors, stats->bytes, stats->cached);
+
+        /* main always writes the output */
+        if (stats->write_start) {
+            write_trace_event(out, pool, job, "write", 0, stats->write_start, stats->write);
         }
     }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    finish_output(pool->args->trace_file_name);
+}
 
-    /* and return the pixel we found previously */
-    return ptr;
+/* reports on the files converted in this run, as asked */
+void report_run(struct Pool* pool) {
+    if (pool->args->stats) {
+        print_stats(pool);
+    }
+    if (pool->args->trace_file_name) {
+        write_trace(pool);
+    }
 }
 
-unsigned short hex24_to_15(char* hex24) {
-    /* skip the # sign */
-    hex24++;
+/* starts up the workers, with just one job main does the work itself */
+pthread_t* start_workers(struct Pool* pool) {
+    pthread_t* workers = malloc(sizeof(pthread_t) * pool->args->jobs);
+    pool->next_job = 0;
+    pool->jobs_ready = 0;
+    pool->jobs_written = 0;
+    pool->num_workers = 0;
+    if (pool->args->jobs > 1) {
+        /* the workers inherit the blocked signals, so that they always go
+         * to the main thread which owns the temporary files */
+        block_stop_signals(SIG_BLOCK);
+        for (int i = 0; i < pool->args->jobs; i++) {
+            pthread_create(&workers[i], NULL, worker, pool);
+        }
+        block_stop_signals(SIG_UNBLOCK);
+    }
+    return workers;
+}
 
-    /* break off the pieces */
-    char rs[3], gs[3], bs[3];
-    rs[0] = *hex24++;
-    rs[1] = *hex24++;
-    rs[2] = '\0';
-    gs[0] = *hex24++;
-    gs[1] = *hex24++;
-    gs[2] = '\0';
-    bs[0] = *hex24++;
-    bs[1] = *hex24++;
-    bs[2] = '\0';
+/* waits for the workers to run out of jobs */
+void join_workers(struct Pool* pool, pthread_t* workers) {
+    if (pool->args->jobs > 1) {
+        for (int i = 0; i < pool->args->jobs; i++) {
+            pthread_join(workers[i], NULL);
+        }
+    }
+    free(workers);
+}
 
-    /* convert from hex string to int */
-    int r = strtol(rs, NULL, 16);
-    int g = strtol(gs, NULL, 16);
-    int b = strtol(bs, NULL, 16);
+/* does the conversion of a job, or waits for a worker to */
+void wait_for_job(struct Pool* pool, int i) {
+    struct Job* job = &pool->jobs[i];
+    if (pool->args->jobs > 1) {
+        pthread_mutex_lock(&pool->lock);
+        while (!job->done) {
+            pthread_cond_wait(&pool->job_done, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    } else {
+        convert_job(pool, i);
+    }
+}
+
+/* lets the workers move on once a job is written out */
+void mark_written(struct Pool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->jobs_written++;
+    pthread_cond_broadcast(&pool->job_written);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* hands the jobs up to window jobs past the one being written over to the
+ * workers, first opening the files of those which are written as they go,
+ * so a worker never sees the files of a job change under it, the rest are
+ * kept whole and main opens their files once they are done, which is all
+ * but the job being written for a batch going into one file, so when that
+ * is streamed the workers don't get ahead of it */
+void ready_jobs(struct Pool* pool) {
+    struct arguments* args = pool->args;
+    int i = pool->jobs_written;
+    int ahead = args->jobs > 1 && !(args->options.stream && args->options.output_file_name);
+    int last = ahead ? i + pool->window : i + 1;
+    if (last > pool->num_jobs) {
+        last = pool->num_jobs;
+    }
 
-    /* build the full 15 bit short */
-    unsigned short color = (b >> 3) << 10;
-    color += (g >> 3) << 5;
-    color += (r >> 3);
+    int ready;
+    for (ready = pool->jobs_ready; ready < last; ready++) {
+        struct Job* job = &pool->jobs[ready];
+        job->opened = !args->watch && !args->num_targets
+            && !(args->cache_dir && !pool->shared_palette)
+            && (!args->options.output_file_name || ready == i);
+        if (job->opened) {
+            char* output_name = png2gba_get_output_name(args->options.output_file_name,
+                    job->name, png2gba_format_extensions[args->options.format]);
+            open_job_files(job, args, pool->shared_palette, output_name,
+                    args->options.output_file_name && ready > 0 ? "ab" : "wb");
+            free(output_name);
+        }
+    }
 
-    return color;
+    pthread_mutex_lock(&pool->lock);
+    if (ready > pool->jobs_ready) {
+        pool->jobs_ready = ready;
+        pthread_cond_broadcast(&pool->job_written);
+    }
+    pthread_mutex_unlock(&pool->lock);
 }
 
-char* get_output_name(char* output_file_name_option, char* input_name){
+/* converts and writes out the whole batch, when watching only the files
+ * which changed are converted again */
+void run_batch(struct Pool* pool) {
+    struct arguments args = *pool->args;
+    struct png2gba_palette* shared_palette = pool->shared_palette;
+    const char* extension_name = png2gba_format_extensions[args.options.format];
     char* output_name;
-    /* if none specified use input name with .h */
-    if (output_file_name_option) {
-        output_name = output_file_name_option;
-    } else {
-        output_name = malloc(sizeof(char) * (strlen(input_name) + 3));
-        sprintf(output_name, "%s.h", input_name);
-    }
-    /* if the name contains directories, like ../test1 or
-     * data/images/bg1 or something, get just the base name */
-    while (strstr(output_name, "/")) {
-        output_name = strstr(output_name, "/") + 1;
-    }
-    return output_name;
-}
-
-/* perform the actual conversion from png to gba formats */
-void png2gba(FILE* in, FILE* out, FILE* palette_out, char* name, struct arguments args, int amount_of_files_to_be_processed) {
-    
-    int palette, tileize;
-    palette = args.palette;
-    tileize = args.tileize; 
-    char* colorkey = args.colorkey;
-    char* output_option = args.output_file_name;
-
-    /* load the image */
-    struct Image* image = read_png(in);
-
-    char palette_option[10];
-    char* index_2d_array_option = "";
-    static int amount_of_files_processed = 1;
-    char beginning_paragraphs[10] = {"{"};
-    char ending_paragraphs[15] = {"};"};
-    static char* previous_output_file_name = "";
-    char* palette_header1 = ""; 
-    char* palette_header2 = ""; 
-    char* palette_header3 = ""; 
-    char* palette_header4 = ""; 
-    char* palette_header5 = "";
-    char* include_header = "";
-    char* include_guard = "";
-
-    char* output_file_name = get_output_name(args.output_file_name, name);
-
-    include_guard = malloc(strlen(output_file_name)-strlen(".h")+1);
-    //Remove ".h" extension from file name
-    strncpy(include_guard, output_file_name, strlen(output_file_name)-strlen(".h"));
-    include_guard[strlen(output_file_name)-strlen(".h")] = '\0';
-    
-    for(size_t i=0; i<strlen(include_guard);i++){
-        include_guard[i] = toupper((unsigned char)include_guard[i]);
-    }
-
-    /* if the name contains directories, like ../test1 or
-     * data/images/bg1 or something, get just the base name */
-    while (strstr(name, "/")) {
-        name = strstr(name, "/") + 1;
-    }
-
-    if(amount_of_files_to_be_processed > 1 && output_option){
-        index_2d_array_option = malloc(strlen("[%d]")+sizeof(amount_of_files_to_be_processed)+1);
-        sprintf(index_2d_array_option, "[%d]", amount_of_files_to_be_processed);
-        strcpy(beginning_paragraphs, "{{");
-        if(amount_of_files_processed == amount_of_files_to_be_processed){
-            //Last file of the batch
-            strcpy(ending_paragraphs, "}};\n\n#endif");
-        }else{
-            strcpy(ending_paragraphs, "}");
-        }
-    }else{
-        strcpy(ending_paragraphs, "};\n\n#endif");
-    }
-
-    if(palette){
-        include_header = malloc(strlen("#include \"palette_%s\"\n\n")+strlen(output_file_name)+1);
-        sprintf(include_header, "#include \"palette_%s\"\n\n", output_file_name);
-    }else{
-        include_header = malloc(strlen("")+1);
-        strcpy(include_header, "");
-    }
-
-    if(strcmp(output_file_name, previous_output_file_name)){
-        //First file of the batch
-        /* write preamble stuff */
-        fprintf(out, "/* %s\n * generated by png2gba program */\n\n", output_file_name);
-        //Add include guard for outdated and new compilers
-        fprintf(out, "#pragma once\n#ifndef %s_H\n#define %s_H\n\n", include_guard, include_guard);
-        fprintf(out, "%s", include_header);
-        fprintf(out, "#define %s_width %d\n", name, image->w);
-        fprintf(out, "#define %s_height %d\n\n", name, image->h);
-        if(output_option){
-            fprintf(out, "#define %s_entries %d\n\n", name, amount_of_files_to_be_processed);
-            palette_header4 = malloc(strlen("#define %s_palette_entries %d\n\n")+strlen(name)+sizeof(amount_of_files_to_be_processed)+1);
-            sprintf(palette_header4, "#define %s_palette_entries %d\n\n", name, amount_of_files_to_be_processed);
-        }else{
-            fprintf(out, "#define %s_entries %d\n\n", name, 1);
-            palette_header4 = malloc(strlen("#define %s_palette_entries %d\n\n")+strlen(name)+sizeof(1)+1);
-            sprintf(palette_header4, "#define %s_palette_entries %d\n\n", name, 1);
-        }
-
-        palette_header1 = malloc(strlen("/* palette_%s\n * generated by png2gba program */\n\n")+strlen(output_file_name)+1);
-        sprintf(palette_header1, "/* palette_%s\n * generated by png2gba program */\n\n", output_file_name);
-        palette_header2 = malloc(strlen("//This palette file belongs to the file %s.h\n")+strlen(name)+1);
-        sprintf(palette_header2, "//This palette file belongs to the file %s.h\n", name);
-        //Add include guard for outdated and new compilers
-        palette_header3 = malloc(strlen("#pragma once\n#ifndef PALETTE_%s_H\n#define PALETTE_%s_H\n\n#include \"%s\"\n\n")+strlen(include_guard)+strlen(include_guard)+strlen(output_file_name)+1);
-        sprintf(palette_header3, "#pragma once\n#ifndef PALETTE_%s_H\n#define PALETTE_%s_H\n\n#include \"%s\"\n\n", include_guard, include_guard, output_file_name);
+    char* palette_output_name;
+
+    /* start again with an empty shared palette */
+    if (shared_palette) {
+        png2gba_init_palette(shared_palette, png2gba_hex24_to_15(args.options.colorkey));
+    }
+
+    pool->run_start = now_seconds();
+    for (int i = 0; i < pool->num_jobs; i++) {
+        pool->jobs[i].done = 0;
+        pool->jobs[i].failed = 0;
+        memset(&pool->jobs[i].stats, 0, sizeof(struct Stats));
+    }
+    pthread_t* workers = start_workers(pool);
+
+    /* the converted data of an ELF object, which is only written once all
+     * of its data is known */
+    struct png2gba_output object;
+    memset(&object, 0, sizeof(struct png2gba_output));
+    char* object_name = NULL;
+
+    /* write the results out in the order the files were given */
+    for(int i=0;i<args.num_input_files;i++){
+        struct Job* job = &pool->jobs[i];
+        char* name = job->name;
+
+        char *file_operand_option = "wb";
         
-        if (palette) {
-            sprintf(palette_option, "char");
+        if(args.options.output_file_name && i > 0){
+            file_operand_option = "ab";
+        }
+        output_name = png2gba_get_output_name(args.options.output_file_name, name, extension_name);
+
+        /* an ELF object is named after the first file of its batch */
+        if (args.options.format == PNG2GBA_FORMAT_ELF) {
+            if (!args.options.output_file_name || i == 0) {
+                object_name = name;
+            }
+        }
+
+        /* when watching the output is kept whole so that it can be reused,
+         * and when caching so that it can be stored, otherwise it is written
+         * as it goes if its files could be opened before it was converted */
+        ready_jobs(pool);
+
+        /* do the conversion on these files, or wait for a worker to */
+        wait_for_job(pool, i);
+        if (!job->opened && !args.watch) {
+            open_job_files(job, &args, shared_palette, output_name, file_operand_option);
+        }
+        if (shared_palette && !job->failed) {
+            convert_image(pool, i, shared_palette);
+        }
+        if (job->failed) {
+            report_failure(pool, job);
+        }
+
+        if (args.watch) {
+            /* a file which failed keeps its last good output */
+            if (job->failed) {
+                copy_output(&job->output, &job->saved);
+            } else {
+                copy_output(&job->saved, &job->output);
+            }
+
+            /* files of their own are only written again when they change */
+            if (!args.options.output_file_name && (!job->changed || job->failed)) {
+                png2gba_free_output(&job->output);
+                free(output_name);
+                mark_written(pool);
+                continue;
+            }
+            open_job_files(job, &args, shared_palette, output_name, file_operand_option);
+        }
+
+        /* close up, we're done */
+        job->stats.write_start = now_seconds();
+        if (args.options.format != PNG2GBA_FORMAT_ELF) {
+            png2gba_buffer_flush(&job->output.data);
+            fclose(job->output.data.file);
+            if(args.options.palette && !shared_palette){
+                png2gba_buffer_flush(&job->output.palette);
+                fclose(job->output.palette.file);
+            }
+            for (int t = 0; t < job->output.num_tables; t++) {
+                char* table_output_name = get_side_file_name(job->output.table_names[t], output_name);
+                job->output.tables[t].file = open_output(table_output_name, file_operand_option);
+                png2gba_buffer_flush(&job->output.tables[t]);
+                fclose(job->output.tables[t].file);
+                free(table_output_name);
+            }
+
+            /* a batch going into one file is complete after its last file */
+            if (!args.options.output_file_name || i == args.num_input_files - 1) {
+                finish_job_files(job, &args, shared_palette, output_name);
+            }
         } else {
-            sprintf(palette_option, "short");
+            buffer_append(&object.data, &job->output.data);
+            buffer_append(&object.palette, &job->output.palette);
+            for (int t = 0; t < job->output.num_tables; t++) {
+                struct png2gba_buffer* table = t < object.num_tables ? &object.tables[t]
+                    : png2gba_add_table(&object, job->output.table_names[t]);
+                buffer_append(table, &job->output.tables[t]);
+            }
+
+            /* the object is complete after its last file */
+            if (!args.options.output_file_name || i == args.num_input_files - 1) {
+                if (shared_palette) {
+                    png2gba_write_binary_palette(&object.palette, shared_palette);
+                }
+                FILE* object_file = open_output(output_name, "wb");
+                char* symbol_name = object_name;
+                while (strstr(symbol_name, "/")) {
+                    symbol_name = strstr(symbol_name, "/") + 1;
+                }
+                png2gba_write_elf(object_file, symbol_name, &object, job->width, job->height,
+                        args.options.section);
+                fclose(object_file);
+                finish_output(output_name);
+                png2gba_free_output(&object);
+            }
         }
-        fprintf(out, "const unsigned %s %s_data %s[%d] = %s\n", palette_option, name, index_2d_array_option, image->w*image->h, beginning_paragraphs);
-        
-        palette_header5 = malloc(strlen("const unsigned short %s_palette %s[%d] = %s\n")+strlen(name)+strlen(index_2d_array_option)+sizeof(PALETTE_SIZE)+strlen(beginning_paragraphs)+1);
-        sprintf(palette_header5, "const unsigned short %s_palette %s[%d] = %s\n", name, index_2d_array_option, PALETTE_SIZE, beginning_paragraphs);
-    }else{
-        palette_header1 = malloc(strlen("")+1);
-        strcpy(palette_header1, "");
-        palette_header2 = malloc(strlen("")+1);
-        strcpy(palette_header2, "");
-        palette_header3 = malloc(strlen("")+1);
-        strcpy(palette_header3, "");
-        palette_header4 = malloc(strlen("")+1);
-        strcpy(palette_header4, "");
-        palette_header5 = malloc(strlen(",{\n")+1);
-        strcpy(palette_header5, ",{\n");
-        fprintf(out, ",{\n");
-    }
-    
-    previous_output_file_name = malloc(strlen(output_file_name)+1);
-    strcpy(previous_output_file_name, output_file_name);
-
-    /* the palette stores up to PALETTE_SIZE colors */
-    unsigned short color_palette[PALETTE_SIZE];
-
-    /* palette sub 0 is reserved for transparent color */
-    unsigned char palette_size = 1;
-
-    /* clear the palette */
-    memset(color_palette, 0, PALETTE_SIZE * sizeof(unsigned short));
-
-    /* insert the transparent color */
-    unsigned short ckey = hex24_to_15(colorkey);
-    color_palette[0] = ckey; 
-
-    /* loop through the pixel data */
-    unsigned char red, green, blue;
-    int colors_this_line = 0;
-    png_byte* ptr;
-
-    while ((ptr = next_byte(image, tileize))) {
-        red = ptr[0];
-        green = ptr[1];
-        blue = ptr[2];
-
-        /* convert to 16-bit color */
-        unsigned short color = (blue >> 3) << 10;
-        color += (green >> 3) << 5;
-        color += (red >> 3);
-
-        /* print leading space if first of line */
-        if (colors_this_line == 0) {
-            fprintf(out, "    ");
-        }
-
-        /* print color directly, or palette index */
-        if (!palette) { 
-            fprintf(out, "0x%04X", color);
+        job->stats.bytes = output_bytes(&job->output);
+        job->stats.write = now_seconds() - job->stats.write_start;
+        png2gba_free_output(&job->output);
+        free(output_name);
+
+        /* let the workers move on */
+        mark_written(pool);
+    }
+    join_workers(pool, workers);
+
+    /* now that every file is in the shared palette it can be written, once
+     * for a combined output file or else once beside each output file */
+    if (shared_palette && args.options.format != PNG2GBA_FORMAT_ELF) {
+        for(int i=0;i<args.num_input_files;i++){
+            if (args.options.output_file_name && i > 0) {
+                break;
+            }
+            char* name = pool->jobs[i].name;
+            output_name = png2gba_get_output_name(args.options.output_file_name, name,
+                    extension_name);
+            palette_output_name = get_side_file_name("palette", output_name);
+            FILE* palette_file = open_output(palette_output_name, "wb");
+            if (args.options.format == PNG2GBA_FORMAT_C) {
+                png2gba_write_shared_palette(palette_file, &args.options, output_name, name,
+                        shared_palette);
+            } else {
+                struct png2gba_buffer palette_output = {NULL, 0, 0, palette_file, 0};
+                png2gba_write_binary_palette(&palette_output, shared_palette);
+                png2gba_buffer_flush(&palette_output);
+                free(palette_output.data);
+            }
+            fclose(palette_file);
+            finish_output(palette_output_name);
+            free(palette_output_name);
+            free(output_name);
+        }
+    }
+    report_run(pool);
+}
+
+/* writes a buffer out to a file of its own */
+void write_buffer_file(char* file_name, struct png2gba_buffer* buffer) {
+    buffer->file = open_output(file_name, "wb");
+    png2gba_buffer_flush(buffer);
+    fclose(buffer->file);
+    buffer->file = NULL;
+    finish_output(file_name);
+}
+
+/* writes an output held in memory out to its files, or its ELF object,
+ * named after output_name and name */
+void write_output_files(struct png2gba_options* options, char* output_name, char* name,
+        struct png2gba_output* output, int width, int height) {
+    if (options->format == PNG2GBA_FORMAT_ELF) {
+        FILE* object_file = open_output(output_name, "wb");
+        char* symbol_name = name;
+        while (strstr(symbol_name, "/")) {
+            symbol_name = strstr(symbol_name, "/") + 1;
+        }
+        png2gba_write_elf(object_file, symbol_name, output, width, height, options->section);
+        fclose(object_file);
+        finish_output(output_name);
+    } else {
+        write_buffer_file(output_name, &output->data);
+        if (output->palette.size) {
+            char* palette_output_name = get_side_file_name("palette", output_name);
+            write_buffer_file(palette_output_name, &output->palette);
+            free(palette_output_name);
+        }
+        for (int t = 0; t < output->num_tables; t++) {
+            char* table_output_name = get_side_file_name(output->table_names[t], output_name);
+            write_buffer_file(table_output_name, &output->tables[t]);
+            free(table_output_name);
+        }
+    }
+}
+
+/* converts the whole batch at once into a sprite atlas or an animation,
+ * which is named after its first file like a batch going into one file */
+void run_combined(struct Pool* pool) {
+    struct arguments* args = pool->args;
+    struct png2gba_image** images = malloc(sizeof(struct png2gba_image*) * pool->num_jobs);
+    struct png2gba_context context;
+    struct png2gba_output output;
+    memset(&output, 0, sizeof(struct png2gba_output));
+    png2gba_init_context(&context, &args->options);
+    pool->run_start = now_seconds();
+
+    for (int i = 0; i < pool->num_jobs; i++) {
+        struct Job* job = &pool->jobs[i];
+        job->stats.start = now_seconds();
+        FILE* input = open_input(pool->jobs[i].input_file_name);
+        if (!input) {
+            fprintf(stderr, "Error: Can not open %s for reading!\n",
+                    pool->jobs[i].input_file_name);
+            exit(-1);
+        }
+        images[i] = png2gba_read_file(&context, input);
+        if (!images[i]) {
+            fprintf(stderr, "Error: %s\n", png2gba_error_message(context.error));
+            exit(-1);
+        }
+        job->stats.map = context.timings.start - job->stats.start;
+        job->stats.timings = context.timings;
+        job->width = images[i]->w;
+        job->height = images[i]->h;
+    }
+
+    /* the conversion of the whole batch goes down to its first file */
+    struct Stats* stats = &pool->jobs[0].stats;
+    char* name = pool->jobs[0].name;
+    stats->convert_start = now_seconds();
+    int error = args->atlas
+        ? png2gba_convert_atlas(&context, images, pool->num_jobs, &output, name)
+        : png2gba_convert_animation(&context, images, pool->num_jobs, &output, name);
+    if (error) {
+        fprintf(stderr, "Error: %s\n", png2gba_error_message(context.error));
+        exit(-1);
+    }
+    if (args->atlas && context.num_tiles > PNG2GBA_MAX_SPRITE_TILES) {
+        fprintf(stderr, "Warning: %d tiles is more than sprite VRAM can hold!\n",
+                context.num_tiles);
+    }
+    stats->timings.convert = context.timings.convert;
+    stats->timings.palette = context.timings.palette;
+    stats->timings.emit = context.timings.emit;
+    stats->colors = context.num_colors;
+
+    stats->write_start = now_seconds();
+    char* output_name = png2gba_get_output_name(args->options.output_file_name, name,
+            png2gba_format_extensions[args->options.format]);
+    write_output_files(&args->options, output_name, name, &output, images[0]->w,
+            images[0]->h);
+
+    stats->bytes = output_bytes(&output);
+    stats->write = now_seconds() - stats->write_start;
+    report_run(pool);
+
+    for (int i = 0; i < pool->num_jobs; i++) {
+        png2gba_free_image(images[i]);
+    }
+    free(images);
+    free(output_name);
+    png2gba_free_output(&output);
+}
+
+/* converts every file of the batch once for each target, decoding it just
+ * once, the workers convert the files and main writes them out in order */
+void run_targets(struct Pool* pool) {
+    struct arguments* args = pool->args;
+    pool->run_start = now_seconds();
+    pthread_t* workers = start_workers(pool);
+
+    for (int i = 0; i < pool->num_jobs; i++) {
+        struct Job* job = &pool->jobs[i];
+        ready_jobs(pool);
+        wait_for_job(pool, i);
+        if (job->failed) {
+            report_failure(pool, job);
+        }
+
+        job->stats.write_start = now_seconds();
+        for (int t = 0; t < args->num_targets; t++) {
+            struct png2gba_options* options = &args->targets[t].options;
+            char* target_name = get_target_name(job, &args->targets[t]);
+            char* output_name = png2gba_get_output_name(NULL, target_name,
+                    png2gba_format_extensions[options->format]);
+            write_output_files(options, output_name, target_name, &job->target_outputs[t],
+                    job->width, job->height);
+            job->stats.bytes += output_bytes(&job->target_outputs[t]);
+            png2gba_free_output(&job->target_outputs[t]);
+            free(output_name);
+            free(target_name);
+        }
+        job->stats.write = now_seconds() - job->stats.write_start;
+        free(job->target_outputs);
+        job->target_outputs = NULL;
+        mark_written(pool);
+    }
+    join_workers(pool, workers);
+    report_run(pool);
+}
+
+#ifdef __linux__
+
+/* how long to wait for more events once a file is saved, since editors
+ * often save in several steps */
+#define WATCH_SETTLE_MS 10
+
+/* marks the jobs named by a buffer of inotify events as changed, returns
+ * how many events matched */
+int mark_changed(struct Pool* pool, int* watches, char* events, ssize_t size) {
+    int matched = 0;
+    char* p = events;
+    while (p < events + size) {
+        struct inotify_event* event = (struct inotify_event*) p;
+        for (int i = 0; event->len && i < pool->num_jobs; i++) {
+            char* base = strrchr(pool->jobs[i].input_file_name, '/');
+            base = base ? base + 1 : pool->jobs[i].input_file_name;
+            if (watches[i] == event->wd && !strcmp(base, event->name)) {
+                pool->jobs[i].changed = 1;
+                matched++;
+            }
+        }
+        p += sizeof(struct inotify_event) + event->len;
+    }
+    return matched;
+}
+
+/* converts the files of a batch again whenever they are saved, which never
+ * returns, the directories are watched rather than the files themselves so
+ * that files which are saved by renaming a new file over them are seen */
+void watch_batch(struct Pool* pool) {
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Can not watch the input files!\n");
+        exit(-1);
+    }
+
+    int* watches = malloc(sizeof(int) * pool->num_jobs);
+    for (int i = 0; i < pool->num_jobs; i++) {
+        char* directory = strdup(pool->jobs[i].input_file_name);
+        char* slash = strrchr(directory, '/');
+        if (slash) {
+            slash[1] = '\0';
         } else {
-            unsigned char index = insert_palette(color, color_palette,
-                    &palette_size);
-            fprintf(out, "0x%02X", index);
-        }
-
-        fprintf(out, ", ");
-
-        /* increment colors on line unless too many */
-        colors_this_line++;
-        if ((palette && colors_this_line >= MAX_ROW8) ||
-                (!palette && colors_this_line >= MAX_ROW16)) {
-            fprintf(out, "\n");
-            colors_this_line = 0;
-        } 
-    }
-
-    /* write postamble stuff */
-    fprintf(out, "\n%s", ending_paragraphs);
-
-    /* write the palette if needed */
-    if (palette) {
-        int colors_this_line = 0;
-        fprintf(palette_out, "%s",palette_header1);
-        fprintf(palette_out, "%s",palette_header2);
-        fprintf(palette_out, "%s",palette_header3);
-        fprintf(palette_out, "%s",palette_header4);
-        fprintf(palette_out, "%s",palette_header5); 
-        int i;
-        for (i = 0; i < PALETTE_SIZE; i++) {
-            if (colors_this_line == 0) {
-                fprintf(palette_out, "    "); 
+            strcpy(directory, ".");
+        }
+        watches[i] = inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watches[i] < 0) {
+            fprintf(stderr, "Error: Can not watch %s!\n", directory);
+            exit(-1);
+        }
+        free(directory);
+    }
+
+    /* from here on only the files which are saved get converted */
+    for (int i = 0; i < pool->num_jobs; i++) {
+        pool->jobs[i].changed = 0;
+    }
+    pool->watching = 1;
+    fprintf(stderr, "Watching %d files for changes...\n", pool->num_jobs);
+
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (1) {
+        ssize_t size = read(fd, events, sizeof(events));
+        if (size <= 0 || !mark_changed(pool, watches, events, size)) {
+            continue;
+        }
+
+        /* let the rest of the save come in */
+        struct pollfd waiting = {fd, POLLIN, 0};
+        while (poll(&waiting, 1, WATCH_SETTLE_MS) > 0) {
+            size = read(fd, events, sizeof(events));
+            if (size > 0) {
+                mark_changed(pool, watches, events, size);
             }
-            fprintf(palette_out, "0x%04x", color_palette[i]);
-            if (i != (PALETTE_SIZE - 1)) {
-                fprintf(palette_out, ", ");
+        }
+
+        /* every file depends on a shared palette */
+        for (int i = 0; i < pool->num_jobs; i++) {
+            if (pool->shared_palette) {
+                pool->jobs[i].changed = 1;
             }
-            colors_this_line++;
-            if (colors_this_line > 8) {
-                fprintf(palette_out, "\n");
-                colors_this_line = 0;
+        }
+        run_batch(pool);
+        for (int i = 0; i < pool->num_jobs; i++) {
+            if (pool->jobs[i].changed && !pool->jobs[i].failed) {
+                fprintf(stderr, "Converted %s\n", pool->jobs[i].input_file_name);
             }
+            pool->jobs[i].changed = 0;
         }
-        fprintf(palette_out, "\n%s", ending_paragraphs);
     }
-    amount_of_files_processed++;
 }
 
+#endif
+
 int main(int argc, char** argv) {
     /* set up the arguments structure */
     struct arguments args;
 
     /* the default values */
-    args.output_file_name = NULL;
+    png2gba_default_options(&args.options);
     args.input_file_name = NULL;
-    args.colorkey = "#ff00ff";
-    args.palette = 0;
-    args.tileize = 0;
+    args.shared_palette = 0;
+    args.jobs = 1;
+    args.cache_dir = NULL;
+    args.watch = 0;
+    args.atlas = 0;
+    args.anim = 0;
+    args.stats = 0;
+    args.trace_file_name = NULL;
+    args.num_targets = 0;
+    args.parsing_target = 0;
+
+    /* there can never be more input files than arguments */
+    args.input_file_names = malloc(sizeof(char*) * argc);
+    args.num_input_files = 0;
+    args.target_specs = malloc(sizeof(char*) * argc);
+
+    /* no temporary file is left behind by an error or being stopped */
+    atexit(remove_temp_files);
+    signal(SIGINT, stop_on_signal);
+    signal(SIGTERM, stop_on_signal);
 
     /* parse command line */
     argp_parse(&info, argc, argv, 0, 0, &args);
 
-    //The count parameters used, command-program itself takes up one space so start counting starting from 1
-    //Some parameters take two spaces, one for the option and another for the option input
-    int command_offset = 1 + args.palette + args.tileize + (strcmp(args.colorkey, "#ff00ff") != 0) + ((args.output_file_name != NULL)*2);
+    /* targets each write their own files for every file of the batch */
+    if (args.num_targets && (args.options.output_file_name || args.shared_palette
+                || args.options.stream || args.watch || args.cache_dir || args.atlas || args.anim)) {
+        fprintf(stderr, "Error: Targets can not be combined with -o, -s, --stream, --watch, --cache, --atlas or --anim!\n");
+        exit(-1);
+    }
+    parse_targets(&args, argv[0]);
 
-    /* set output file if name given */
-    FILE* output;
-    FILE* palette_output;
-    char* output_name;
-    char* palette_output_name;
-    //Initialize name with a value as a fall back option
-    char* name = strdup(args.input_file_name);
+    /* a batch shares one array, which a screen map can't index into */
+    if (args.options.dedup && args.options.output_file_name && args.num_input_files > 1) {
+        fprintf(stderr, "Error: Repeated tiles can not be removed when a batch goes in one file!\n");
+        exit(-1);
+    }
 
-    FILE* input;
+    /* nor can the banks of the tiles, and the banks are worked out from the
+     * tiles of each image on its own */
+    if (args.options.bpp4 && ((args.options.output_file_name && args.num_input_files > 1)
+                || args.shared_palette)) {
+        fprintf(stderr, "Error: 4bpp tiles can not be combined with -s or a batch in one file!\n");
+        exit(-1);
+    }
+
+    /* compressed entries differ in size, so they can't share one array, and
+     * a shared palette is written without them */
+    if (args.options.compress && ((args.options.output_file_name && args.num_input_files > 1)
+                || args.shared_palette)) {
+        fprintf(stderr, "Error: Compression can not be combined with -s or a batch in one file!\n");
+        exit(-1);
+    }
+
+    /* only a screen map can be laid out */
+    if (args.options.layout && !args.options.dedup) {
+        fprintf(stderr, "Error: A map layout needs the screen map of -d!\n");
+        exit(-1);
+    }
+
+    /* these need the whole image at once */
+    if (args.options.stream && (args.options.quantize || args.options.dedup
+                || args.options.bpp4 || args.shared_palette)) {
+        fprintf(stderr, "Error: Streaming can not be combined with -q, -d, -4 or -s!\n");
+        exit(-1);
+    }
+
+    /* and these keep the whole output in memory */
+    if (args.options.stream && (args.cache_dir || args.watch
+                || args.options.format == PNG2GBA_FORMAT_ELF)) {
+        fprintf(stderr, "Error: Streaming can not be combined with --cache, --watch or -f elf!\n");
+        exit(-1);
+    }
+
+    /* an atlas is one conversion of the whole batch into 8bpp tiles */
+    if (args.atlas && (args.options.dedup || args.options.bpp4 || args.options.compress
+                || args.options.stream || args.watch || args.cache_dir)) {
+        fprintf(stderr, "Error: An atlas can not be combined with -d, -4, -z, --stream, --watch or --cache!\n");
+        exit(-1);
+    }
+
+    /* and so is an animation, into tiles which are compared frame to frame */
+    if (args.anim && (args.atlas || args.options.dedup || args.options.bpp4
+                || args.options.compress || args.options.stream || args.watch || args.cache_dir)) {
+        fprintf(stderr, "Error: An animation can not be combined with --atlas, -d, -4, -z, --stream, --watch or --cache!\n");
+        exit(-1);
+    }
+
+    /* standard input can only be read once, and never again when watching */
+    int stdin_files = 0;
+    for (int i = 0; i < args.num_input_files; i++) {
+        stdin_files += !strcmp(args.input_file_names[i], "-");
+    }
+    if (stdin_files > 1 || (stdin_files && args.watch)) {
+        fprintf(stderr, "Error: Standard input can only be read once, and can not be watched!\n");
+        exit(-1);
+    }
+
+#ifndef __linux__
+    if (args.watch) {
+        fprintf(stderr, "Error: Watching files is only supported on Linux!\n");
+        exit(-1);
+    }
+#endif
 
-    for(int i=command_offset;i<argc;i++){
-        //Copy the first argument of the regex given to the commandline
-        strcpy(name, argv[i]);
-        /* the image name without the extension */
+    /* make the cache directory on first use */
+    if (args.cache_dir) {
+        mkdir(args.cache_dir, 0777);
+    }
+
+    /* the palette shared by the whole batch, if requested */
+    struct png2gba_palette* shared_palette = NULL;
+    if (args.options.palette && args.shared_palette) {
+        shared_palette = malloc(sizeof(struct png2gba_palette));
+    }
+
+    /* set up a job for each file */
+    struct Pool pool;
+    pool.jobs = calloc(args.num_input_files, sizeof(struct Job));
+    pool.num_jobs = args.num_input_files;
+    pool.window = args.jobs * 2;
+    pool.args = &args;
+    pool.shared_palette = shared_palette;
+    pool.watching = 0;
+    pool.num_workers = 0;
+    pool.origin = now_seconds();
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.job_done, NULL);
+    pthread_cond_init(&pool.job_written, NULL);
+
+    for(int i=0;i<args.num_input_files;i++){
+        /* the image name without the extension, standard input is named
+         * after the output file if there is one */
+        char* name = strdup(args.input_file_names[i]);
+        if (!strcmp(name, "-")) {
+            const char* base = args.options.output_file_name ? args.options.output_file_name : "stdin";
+            const char* slash = strrchr(base, '/');
+            const char* dot = strrchr(slash ? slash : base, '.');
+            int length = dot ? (int) (dot - base) : (int) strlen(base);
+            free(name);
+            name = malloc(length + strlen(".png") + 1);
+            sprintf(name, "%.*s.png", length, base);
+        }
         char* extension = strstr(name, ".png");
         if (!extension) {
             fprintf(stderr, "Error: File name should end in .png!\n");
             exit(-1);
         }
         *extension = '\0';
+        pool.jobs[i].input_file_name = args.input_file_names[i];
+        pool.jobs[i].name = name;
+        pool.jobs[i].changed = 1;
+    }
 
-        char *file_operand_option = "w";;
-        
-        if(args.output_file_name && i > command_offset){
-            file_operand_option = "a";
-        }
-        output_name = get_output_name(args.output_file_name, name);
+    if (args.atlas || args.anim) {
+        run_combined(&pool);
+        return 0;
+    }
+    if (args.num_targets) {
+        run_targets(&pool);
+        return 0;
+    }
 
-        /* set input file to what was passed in */
-        input = fopen(argv[i], "rb");
-        if (!input) {
-            fprintf(stderr, "Error: Can not open %s for reading!\n",
-                    args.input_file_name);
-            return -1;
-        }
+    run_batch(&pool);
 
-        if(args.palette){
-            palette_output_name = malloc(sizeof(char) * (strlen(output_name) + strlen("palette_") + 1));
-            sprintf(palette_output_name, "palette_%s", output_name);
-            palette_output = fopen(palette_output_name, file_operand_option);
-        }
-        output = fopen(output_name, file_operand_option);
-        /* do the conversion on these files */
-        png2gba(input, output, palette_output, name, args, (argc-command_offset));
-        /* close up, we're done */
-        fclose(output);
-        if(args.palette){
-           fclose(palette_output);
-        }
+#ifdef __linux__
+    if (args.watch) {
+        watch_batch(&pool);
     }
+#endif
 
     return 0;
 }
-
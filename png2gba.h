@@ -0,0 +1,300 @@
+/* png2gba.h
+ * the png2gba library, which converts PNG images into the arrays of data
+ * used for programming the GBA, the png2gba program is a thin wrapper
+ * around it
+ *
+ * nothing in the library keeps global state or exits, every call reports
+ * failure with an error code, so any number of images can be converted in
+ * one process, and on several threads as long as each has its own context,
+ * only running out of memory aborts */
+
+#ifndef PNG2GBA_H
+#define PNG2GBA_H
+
+#include <stdio.h>
+#include <png.h>
+
+/* the GBA palette size is always 256 colors */
+#define PNG2GBA_PALETTE_SIZE 256
+
+/* the number of distinct 15-bit GBA colors */
+#define PNG2GBA_COLOR_SPACE_SIZE 32768
+
+/* the GBA always uses 8x8 tiles */
+#define PNG2GBA_TILE_SIZE 8
+
+/* the most tiles a screen entry can refer to */
+#define PNG2GBA_MAX_SCREEN_TILES 1024
+
+/* the most 8bpp tiles sprite VRAM can hold */
+#define PNG2GBA_MAX_SPRITE_TILES 512
+
+/* the most extra tables, like a tile map, that one image can produce */
+#define PNG2GBA_MAX_TABLES 4
+
+/* the error codes returned by the library */
+enum png2gba_error {
+    PNG2GBA_OK,
+    PNG2GBA_ERROR_NOT_PNG,
+    PNG2GBA_ERROR_READ,
+    PNG2GBA_ERROR_COLOR_TYPE,
+    PNG2GBA_ERROR_TOO_MANY_COLORS,
+    PNG2GBA_ERROR_TILE_SIZE,
+    PNG2GBA_ERROR_TILE_COLORS,
+    PNG2GBA_ERROR_TOO_MANY_BANKS,
+    PNG2GBA_ERROR_FRAME_SIZE,
+    PNG2GBA_ERROR_TOO_MANY_TILES,
+    PNG2GBA_ERROR_COMPRESS_SIZE
+};
+
+/* the kinds of output files we can write, C headers, raw little endian data
+ * or an ARM ELF object which can be linked directly */
+enum png2gba_format {
+    PNG2GBA_FORMAT_C,
+    PNG2GBA_FORMAT_BIN,
+    PNG2GBA_FORMAT_ELF
+};
+
+/* the compression which can be used on the data and palette, in the
+ * formats the GBA BIOS decompression calls read */
+enum png2gba_compression {
+    PNG2GBA_COMPRESS_NONE,
+    PNG2GBA_COMPRESS_LZ77,
+    PNG2GBA_COMPRESS_RLE,
+    PNG2GBA_COMPRESS_HUFFMAN
+};
+
+/* the file extension used for each format when no output name is given */
+extern const char* png2gba_format_extensions[];
+
+/* where the arrays of C headers and ELF objects are placed on the GBA, the
+ * RAM sections are copied there from ROM at startup */
+enum png2gba_section {
+    PNG2GBA_SECTION_ROM,
+    PNG2GBA_SECTION_EWRAM,
+    PNG2GBA_SECTION_IWRAM
+};
+
+/* the linker section used for each placement */
+extern const char* png2gba_section_names[];
+
+/* how the screen map of deduplicated tiles is laid out, flat is one row
+ * after another, the others split it into 32x32 screenblocks padded with
+ * entry 0 or into strips of a row or a column each, with an index table of
+ * where each one starts */
+enum png2gba_layout {
+    PNG2GBA_LAYOUT_FLAT,
+    PNG2GBA_LAYOUT_SCREENBLOCKS,
+    PNG2GBA_LAYOUT_ROWS,
+    PNG2GBA_LAYOUT_COLUMNS
+};
+
+/* how images are converted, these match the command line options, words
+ * writes the arrays of C headers as 32-bit words, which are always aligned
+ * like align asks for */
+struct png2gba_options {
+    int palette;
+    int tileize;
+    int quantize;
+    int dedup;
+    int stream;
+    int bpp4;
+    int words;
+    int align;
+    enum png2gba_section section;
+    enum png2gba_layout layout;
+    enum png2gba_format format;
+    enum png2gba_compression compress;
+    char* colorkey;
+    char* output_file_name;
+};
+
+/* how long each phase of the last image took in seconds, reading an image
+ * starts them over and converting it adds to them, palette is the time spent
+ * putting colors into the palette, which is left out of convert, and start
+ * is when reading began, in seconds on the monotonic clock */
+struct png2gba_timings {
+    double decode;
+    double convert;
+    double palette;
+    double emit;
+    double start;
+};
+
+/* the state of the conversions done on one thread, after a call fails its
+ * error code is also kept in error, num_colors is how many slots of the
+ * palette the last conversion filled, including the transparent one */
+struct png2gba_context {
+    struct png2gba_options options;
+    int error;
+    int num_tiles;
+    int num_colors;
+    struct png2gba_timings timings;
+};
+
+/* memory which lasts as long as one image, its rows and everything its
+ * conversion needs come out of a few big blocks which are freed together */
+struct png2gba_arena {
+    struct png2gba_arena_block* blocks;
+};
+
+/* where the memory holding a PNG image came from, which says how it is let
+ * go, the caller's memory is left alone */
+enum png2gba_memory_kind {
+    PNG2GBA_MEMORY_BORROWED,
+    PNG2GBA_MEMORY_ALLOCATED,
+    PNG2GBA_MEMORY_MAPPED
+};
+
+/* a PNG image coming from memory, and how much of it has been read */
+struct png2gba_memory {
+    const unsigned char* data;
+    size_t size;
+    size_t offset;
+    enum png2gba_memory_kind kind;
+};
+
+/* a PNG image we load, always from memory, when it is streamed the reader
+ * stays open and the rows are read a band at a time instead of being kept
+ * in rows, an indexed image keeps one byte indices into the colors of its
+ * PNG palette, set share_colors before converting an image several times
+ * and its rows are only converted to colors once, in row order and in tile
+ * order, which every conversion then starts from */
+struct png2gba_image {
+    int w, h, channels;
+    int indexed;
+    int share_colors;
+    unsigned short* colors[2];
+    unsigned short* band;
+    unsigned short plte[PNG2GBA_PALETTE_SIZE];
+    int plte_size;
+    png_byte color_type;
+    png_byte bit_depth;
+    png_bytep* rows;
+    struct png2gba_memory memory;
+    png_structp png_reader;
+    png_infop png_info;
+    struct png2gba_arena arena;
+};
+
+/* a palette of GBA colors, along with a reverse index from every possible
+ * 15-bit color to its slot so that lookups take constant time */
+struct png2gba_palette {
+    unsigned short colors[PNG2GBA_PALETTE_SIZE];
+    int size;
+    short index[PNG2GBA_COLOR_SPACE_SIZE];
+};
+
+/* a growable chunk of output waiting to be written to its file, when there
+ * is no file the output just accumulates, written counts what has already
+ * gone to the file */
+struct png2gba_buffer {
+    char* data;
+    size_t size;
+    size_t capacity;
+    FILE* file;
+    size_t written;
+};
+
+/* everything converted from one image, in the binary formats each extra
+ * table is written to a file of its own named after the table, or to a
+ * symbol of its own in an ELF object, while C headers get them as text */
+struct png2gba_output {
+    struct png2gba_buffer data;
+    struct png2gba_buffer palette;
+    struct png2gba_buffer tables[PNG2GBA_MAX_TABLES];
+    const char* table_names[PNG2GBA_MAX_TABLES];
+    int num_tables;
+};
+
+/* fills in the default options, a 16-bit C header with #ff00ff as the
+ * transparent color */
+void png2gba_default_options(struct png2gba_options* options);
+
+/* sets up a context for converting with the given options */
+void png2gba_init_context(struct png2gba_context* context, struct png2gba_options* options);
+
+/* describes an error code */
+const char* png2gba_error_message(int error);
+
+/* maps a whole PNG file into memory, or reads it in when it can't be mapped
+ * like a pipe, then closes the file, returns an error code */
+int png2gba_map_file(FILE* in, struct png2gba_memory* memory);
+
+/* lets go of the memory of a PNG image, unless it is borrowed */
+void png2gba_unmap(struct png2gba_memory* memory);
+
+/* loads a PNG image from memory from png2gba_map_file, which the image then
+ * owns, even on failure, with the stream option just the header is read if
+ * the rows can be read in order, returns NULL on failure */
+struct png2gba_image* png2gba_read_mapped(struct png2gba_context* context,
+        struct png2gba_memory* memory);
+
+/* loads a PNG image from a file by mapping it, the file is closed, returns
+ * NULL on failure */
+struct png2gba_image* png2gba_read_file(struct png2gba_context* context, FILE* in);
+
+/* loads a PNG image from memory, which has to stay around while a streamed
+ * image is converted, returns NULL on failure */
+struct png2gba_image* png2gba_read_memory(struct png2gba_context* context, const void* data,
+        size_t size);
+
+/* frees an image, its rows and everything its conversions used, along with
+ * the memory it was read from unless that is borrowed */
+void png2gba_free_image(struct png2gba_image* image);
+
+/* converts an image into output, index is where the image is in a batch of
+ * amount_of_files_to_be_processed, if shared_palette is given the colors go
+ * into it and no palette is written, returns an error code */
+int png2gba_convert(struct png2gba_context* context, struct png2gba_image* image,
+        struct png2gba_output* output, char* name, int index,
+        int amount_of_files_to_be_processed, struct png2gba_palette* shared_palette);
+
+/* reads and converts one PNG image held in memory into output, whose
+ * buffers have no files so everything stays in memory */
+int png2gba_convert_memory(struct png2gba_context* context, const void* data,
+        size_t size, char* name, struct png2gba_output* output);
+
+/* packs a batch of count sprites into one atlas of 8bpp tiles laid out for
+ * 1D sprite mapping, with one palette for all of them, each sprite is split
+ * into OAM shapes, leaving out transparent ones and sharing the tiles of
+ * repeated ones, which go in an objects table of x, y and OAM attributes
+ * 0-2, followed by a frames table of the first object, number of objects,
+ * width and height of each sprite, the memory it needs comes from the first
+ * image, returns an error code */
+int png2gba_convert_atlas(struct png2gba_context* context, struct png2gba_image** images,
+        int count, struct png2gba_output* output, char* name);
+
+/* converts a batch of count frames of the same size into a tileized
+ * animation with one palette, the first frame is the data in full and
+ * every later frame is the tiles which changed since the frame before it,
+ * in a delta_tiles table of their values, a delta_indices table of their
+ * tile numbers and a delta_frames table of the first delta and number of
+ * deltas of each frame, the memory it needs comes from the first image,
+ * returns an error code */
+int png2gba_convert_animation(struct png2gba_context* context, struct png2gba_image** images,
+        int count, struct png2gba_output* output, char* name);
+
+/* empty a palette, leaving only the transparent color in slot 0 */
+void png2gba_init_palette(struct png2gba_palette* palette, unsigned short colorkey);
+
+/* converts a #rrggbb color into a 15-bit color */
+unsigned short png2gba_hex24_to_15(char* hex24);
+
+/* frees everything in an output, leaving it empty */
+void png2gba_free_output(struct png2gba_output* output);
+
+/* writes a complete palette file for a palette shared by a batch */
+void png2gba_write_shared_palette(FILE* palette_file, struct png2gba_options* options,
+        char* output_file_name, char* name, struct png2gba_palette* color_palette);
+
+/* writes the colors of a palette as raw little endian data */
+void png2gba_write_binary_palette(struct png2gba_buffer* palette_out,
+        struct png2gba_palette* color_palette);
+
+/* writes a relocatable ARM ELF object holding an output in the given
+ * section */
+void png2gba_write_elf(FILE* out_file, char* name, struct png2gba_output* output,
+        int width, int height, enum png2gba_section section);
+
+#endif
@@ -0,0 +1,26 @@
+/* png2gba_private.h
+ * the helpers of the png2gba library which only the library itself and the
+ * png2gba program use, they are not part of its interface */
+
+#ifndef PNG2GBA_PRIVATE_H
+#define PNG2GBA_PRIVATE_H
+
+#include "png2gba.h"
+
+/* output is collected in memory and written out in chunks of this size */
+#define FLUSH_SIZE 65536
+
+/* the name of the output file for an input name without its extension,
+ * which the caller frees */
+char* png2gba_get_output_name(char* output_file_name_option, char* input_name,
+        const char* extension);
+
+/* writing to buffers */
+char* png2gba_buffer_reserve(struct png2gba_buffer* buffer, size_t count);
+void png2gba_buffer_write(struct png2gba_buffer* buffer, const void* data, size_t size);
+void png2gba_buffer_flush(struct png2gba_buffer* buffer);
+
+/* adds an extra table to an output and returns its buffer */
+struct png2gba_buffer* png2gba_add_table(struct png2gba_output* output, const char* table_name);
+
+#endif
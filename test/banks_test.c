@@ -0,0 +1,80 @@
+/* banks_test.c
+ * checks that the 4bpp tiles of -4 use as few palette banks as they can,
+ * by converting small images with the png2gba library */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "png2gba.h"
+
+/* the colors the test images are drawn with */
+const unsigned char test_colors[][3] = {
+    {0xff, 0x00, 0x00}, {0x00, 0xff, 0x00}, {0x00, 0x00, 0xff}, {0xff, 0xff, 0x00}
+};
+
+/* builds a w by h RGB image whose pixel x, y has the color color_at gives,
+ * then converts it into 4bpp tiles and returns how many banks it took, or
+ * -1 if it didn't convert */
+int count_banks(int w, int h, int (*color_at)(int x, int y)) {
+    unsigned char* pixels = malloc(w * h * 3);
+    int x, y;
+    for (y = 0; y < h; y++) {
+        for (x = 0; x < w; x++) {
+            memcpy(pixels + (y * w + x) * 3, test_colors[color_at(x, y)], 3);
+        }
+    }
+
+    png_image png;
+    memset(&png, 0, sizeof(png_image));
+    png.version = PNG_IMAGE_VERSION;
+    png.width = w;
+    png.height = h;
+    png.format = PNG_FORMAT_RGB;
+    png_alloc_size_t size = 0;
+    png_image_write_to_memory(&png, NULL, &size, 0, pixels, 0, NULL);
+    void* data = malloc(size);
+    png_image_write_to_memory(&png, data, &size, 0, pixels, 0, NULL);
+    free(pixels);
+
+    struct png2gba_options options;
+    struct png2gba_context context;
+    struct png2gba_output output;
+    png2gba_default_options(&options);
+    options.palette = 1;
+    options.tileize = 1;
+    options.bpp4 = 1;
+    png2gba_init_context(&context, &options);
+    memset(&output, 0, sizeof(struct png2gba_output));
+    int error = png2gba_convert_memory(&context, data, size, "test", &output);
+    png2gba_free_output(&output);
+    free(data);
+
+    /* every bank takes 16 slots of the palette */
+    return error ? -1 : context.num_colors / 16;
+}
+
+/* four tiles, each of one of the four colors */
+int four_colors(int x, int y) {
+    return (x / PNG2GBA_TILE_SIZE + y / PNG2GBA_TILE_SIZE * 2) % 4;
+}
+
+/* two tiles, the first of the first two colors and the second of the
+ * other two */
+int two_tiles(int x, int y) {
+    return (x / PNG2GBA_TILE_SIZE) * 2 + y % 2;
+}
+
+/* checks a case, returns whether it passed */
+int check(const char* name, int banks, int expected) {
+    printf("%s: %d banks, expected %d, %s\n", name, banks, expected,
+            banks == expected ? "ok" : "FAILED");
+    return banks == expected;
+}
+
+int main() {
+    int passed = 1;
+    passed &= check("four colors", count_banks(16, 16, four_colors), 1);
+    passed &= check("two tiles of two colors", count_banks(16, 8, two_tiles), 1);
+    return passed ? 0 : 1;
+}